@@ -0,0 +1,71 @@
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace cndl {
+
+namespace {
+
+constexpr std::size_t max_pooled_buffers  = 32;
+// larger buffers are given back to the allocator, otherwise a few big transfers would pin lots of memory
+constexpr std::size_t max_pooled_capacity = 64 * 1024;
+
+using Buffers = std::vector<std::vector<std::byte>>;
+
+// thread locals are destroyed before statics, whose destructors may still release buffers
+thread_local bool destroyed{false};
+
+struct Pool {
+    Buffers buffers;
+    ~Pool() {
+        destroyed = true;
+    }
+};
+
+// nullptr once the pool of this thread is gone
+Buffers* thread_pool() {
+    if (destroyed) {
+        return nullptr;
+    }
+    thread_local Pool pool;
+    return &pool.buffers;
+}
+
+}
+
+std::vector<std::byte> acquire_buffer(std::size_t capacity) {
+    std::vector<std::byte> buffer;
+    auto* pool = thread_pool();
+    if (not pool) {
+        buffer.reserve(capacity);
+        return buffer;
+    }
+    // take the smallest buffer that is big enough (or the biggest one we have)
+    auto it = std::min_element(begin(*pool), end(*pool), [capacity](auto const& l, auto const& r) {
+        bool l_fits = l.capacity() >= capacity;
+        bool r_fits = r.capacity() >= capacity;
+        if (l_fits != r_fits) {
+            return l_fits;
+        }
+        return l_fits ? l.capacity() < r.capacity() : l.capacity() > r.capacity();
+    });
+    if (it != end(*pool)) {
+        std::iter_swap(it, std::prev(end(*pool)));
+        buffer = std::move(pool->back());
+        pool->pop_back();
+    }
+    buffer.reserve(capacity);
+    return buffer;
+}
+
+void release_buffer(std::vector<std::byte>&& buffer) {
+    auto* pool = thread_pool();
+    if (not pool or buffer.capacity() == 0 or buffer.capacity() > max_pooled_capacity or pool->size() >= max_pooled_buffers) {
+        return;
+    }
+    buffer.clear();
+    pool->emplace_back(std::move(buffer));
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cndl {
+
+// a thread local free list of byte buffers
+// buffers that were sent out are released here so that serializing the next response can reuse their capacity
+std::vector<std::byte> acquire_buffer(std::size_t capacity);
+void release_buffer(std::vector<std::byte>&& buffer);
+
+}
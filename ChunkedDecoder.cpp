@@ -0,0 +1,89 @@
+#include "ChunkedDecoder.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace cndl {
+
+namespace {
+
+// chunk size lines (including extensions) and trailer fields longer than that are not worth waiting for
+constexpr std::size_t max_line_size = 8 * 1024;
+
+// the position of the next CRLF, npos if there is none yet
+std::size_t find_line_end(std::string_view data) {
+    auto eol = data.find("\r\n");
+    if (eol == std::string_view::npos and data.size() > max_line_size) {
+        throw Error(400, "chunked encoding: line too long");
+    }
+    return eol;
+}
+
+}
+
+std::string_view ChunkedDecoder::next(std::string_view data, std::size_t& consumed) {
+    consumed = 0;
+    while (state != State::done) {
+        switch (state) {
+        case State::size_line: {
+            auto eol = find_line_end(data);
+            if (eol == std::string_view::npos) {
+                return {};
+            }
+            auto line = data.substr(0, eol);
+            auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), remaining, 16);
+            auto rest = line.substr(ptr - line.data());
+            if (ec != std::errc{} or ptr == line.data() or not (rest.empty() or rest[0] == ';' or rest[0] == ' ' or rest[0] == '\t')) {
+                throw Error(400, "chunked encoding: invalid chunk size");
+            }
+            data.remove_prefix(eol + 2);
+            consumed += eol + 2;
+            state = remaining == 0 ? State::trailer : State::data;
+            break;
+        }
+        case State::data: {
+            if (data.empty()) {
+                return {};
+            }
+            auto piece = data.substr(0, static_cast<std::size_t>(std::min<std::uint64_t>(remaining, data.size())));
+            remaining -= piece.size();
+            consumed += piece.size();
+            if (remaining == 0) {
+                state = State::data_end;
+            }
+            return piece;
+        }
+        case State::data_end: {
+            if (data.size() < 2) {
+                return {};
+            }
+            if (not data.starts_with("\r\n")) {
+                throw Error(400, "chunked encoding: missing CRLF after chunk");
+            }
+            data.remove_prefix(2);
+            consumed += 2;
+            state = State::size_line;
+            break;
+        }
+        case State::trailer: {
+            auto eol = find_line_end(data);
+            if (eol == std::string_view::npos) {
+                return {};
+            }
+            data.remove_prefix(eol + 2);
+            consumed += eol + 2;
+            // the trailer section ends with an empty line
+            if (eol == 0) {
+                state = State::done;
+            }
+            break;
+        }
+        case State::done:
+            break;
+        }
+    }
+    return {};
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace cndl {
+
+// decodes a body in the chunked transfer coding (RFC 9112, 7.1) piece by piece as it is received
+// chunk extensions and trailer fields are skipped
+struct ChunkedDecoder {
+    // the next piece of content within data (which continues where the previous call left off)
+    // consumed is set to the amount of data that was used up, if that is 0 more data is needed to continue
+    // the returned piece can be empty even if something was consumed (e.g., a chunk header)
+    // throws Error(400) on malformed input
+    std::string_view next(std::string_view data, std::size_t& consumed);
+
+    // whether the last chunk and the trailer section were decoded
+    bool done() const noexcept {
+        return state == State::done;
+    }
+
+private:
+    enum class State {
+        size_line,
+        data,
+        data_end,  // the CRLF after the data of a chunk
+        trailer,
+        done,
+    };
+
+    State state{State::size_line};
+    std::uint64_t remaining{0};
+};
+
+}
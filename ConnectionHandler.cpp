@@ -1,66 +1,483 @@
 #include "ConnectionHandler.h"
 
+#include "BufferPool.h"
+#include "FileReader.h"
+#include "FreeList.h"
 #include "HttpProtocol.h"
+#include "MPSCQueue.h"
 #include "ProtocolHandler.h"
+#include "UringLoop.h"
 
+#include <simplyfile/FileDescriptor.h>
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <mutex>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace cndl {
 namespace {
-bool flush_job(ConnectionHandler::TransmitJob &job, ConnectionHandler::ClientSocket const& con) {
-    auto& [out_buf, bytes_sent, cb] = job;
-    while (bytes_sent < out_buf.size()) {
-        int w = ::send(con, out_buf.data()+bytes_sent, out_buf.size()-bytes_sent, MSG_NOSIGNAL);
-        if (w <= 0 and (errno == EWOULDBLOCK || errno == EAGAIN)) {
-            return false;
+enum class FlushResult {
+    sent,
+    would_block,
+    failed,
+};
+
+FlushResult flush_job(ConnectionHandler::TransmitJob &job, ConnectionHandler::ClientSocket const& con, bool more) {
+    auto& [payload, bytes_sent, cb] = job;
+    auto size = payload_size(payload);
+    auto const* region = std::get_if<FileRegion>(&payload);
+    auto data = payload_bytes(payload);
+    while (bytes_sent < size) {
+        ssize_t w;
+        if (region) {
+            off_t offset = region->offset + bytes_sent;
+            w = ::sendfile(con, region->fd, &offset, size-bytes_sent);
+        } else {
+            // MSG_MORE lets a header go out in one segment with the body that follows in the next job
+            w = ::send(con, data.data()+bytes_sent, size-bytes_sent, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        }
+        if (w == 0) {
+            // the file shrank, the response cannot be completed anymore
+            return FlushResult::failed;
+        }
+        if (w < 0) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                return FlushResult::would_block;
+            }
+            // the connection (or the file) is broken, there is no point in retrying
+            return FlushResult::failed;
         }
         bytes_sent += w;
     }
     if (cb) {
         cb();
     }
-    return true;
+    return FlushResult::sent;
+}
+
+// file regions that are not sent with sendfile are read (and sent) in chunks of this size
+// with a file_reader, regions are sent with sendfile in chunks of this size as long as they are in the page cache
+constexpr std::size_t file_chunk_size = 256 * 1024;
+
+// whether sending [offset, offset+length) of fd with sendfile would not have to wait for the disk
+bool in_page_cache(int fd, std::uint64_t offset, std::size_t length) {
+    static auto const page_size = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    auto begin = offset / page_size * page_size;
+    auto size  = offset + length - begin;
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(begin));
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    std::array<unsigned char, file_chunk_size / 4096 + 2> pages;
+    auto count = (size + page_size - 1) / page_size;
+    bool cached = count <= pages.size() and ::mincore(map, size, pages.data()) == 0
+              and std::all_of(pages.data(), pages.data() + count, [](unsigned char page) { return page & 1; });
+    ::munmap(map, size);
+    return cached;
+}
+
+// the socket is read in pieces of this size
+constexpr int read_size = 4096;
+
+void release_payload(Payload&& payload) {
+    if (auto* buf = std::get_if<ByteBuf>(&payload)) {
+        release_buffer(std::move(*buf));
+    }
+}
+
+// the activity of a connection as seen by the idle sweep (see ConnectionHandler::reclaimIdle)
+struct IdleState {
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<Clock::time_point> last_active{Clock::now()};
+    // set while the state is in idle_connections
+    std::atomic<bool> listed{false};
+    // set by the sweep, the IO loop gives back the buffers of the connection if nothing happened since
+    std::atomic<bool> reclaim{false};
+    ServerOptions const* options{nullptr};
+    unique_func<void()> kick;
+};
+
+// the connections that received or sent something since they last gave back their buffers
+struct IdleConnections {
+    std::mutex mutex;
+    std::vector<std::weak_ptr<IdleState>> states;
+};
+
+IdleConnections& idle_connections() {
+    static IdleConnections instance;
+    return instance;
 }
 }
 
 struct ConnectionHandler::Pimpl {
+    // shared with the wakeup callback registered in the IO loop so that it never outlives its state
+    struct Wakeup {
+        simplyfile::FileDescriptor event_fd{::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)};
+        std::atomic<bool> pending{false};
+        // the registration of the connection: fd is -1 once it is closed (so that a reused fd number is left alone)
+        // and flags are what the connection was armed with last
+        std::mutex mutex;
+        int fd{-1};
+        std::atomic<int> flags{0};
+    };
+
     ClientSocket con;
     Epoll& epoll;
     Dispatcher& dispatcher;
+    ServerOptions const& options;
 
+    // acquired when something is received, connections that never send anything hold no buffer
     ByteBuf in_buf;
+    // transmit_jobs are only touched by the thread that currently handles the IO of this connection
     std::vector<TransmitJob> transmit_jobs;
-    std::recursive_mutex transmit_job_mutex;
+    // jobs that were written from outside of the IO loop, they are handed over to transmit_jobs by the IO loop
+    MPSCQueue<TransmitJob> write_queue;
+    std::shared_ptr<Wakeup> wakeup;
+
+    // if set, file regions are read by its threads instead of being sent by the IO loop (sendfile)
+    FileReader* file_reader{nullptr};
+    // a chunk of the first file region that is being read by the file_reader
+    struct PendingRead {
+        std::atomic<bool> done{false};
+        ByteBuf data;
+    };
+    std::shared_ptr<PendingRead> pending_read;
+
+    // set if the IO of this connection is done through io_uring (see UringLoop)
+    UringLoop* ring{nullptr};
+    std::uint64_t ring_id{0};
+    // the jobs whose linked sends have been submitted to the ring
+    std::deque<TransmitJob> in_flight;
 
     std::unique_ptr<ProtocolHandler> protocol{};
 
+    // set while the protocol does not want to receive more data, resume_pending is set by the resumer (from any thread)
+    bool receive_paused{false};
+    std::shared_ptr<std::atomic<bool>> resume_pending{std::make_shared<std::atomic<bool>>(false)};
+
+    // only set if idle connections give back their buffers (see ServerOptions::idle_reclaim_after)
+    std::shared_ptr<IdleState> idle;
+
     std::atomic<size_t> outBufferSize{0};
 
-    Pimpl(ClientSocket i_con, Epoll& i_epoll, Dispatcher& i_dispatcher, ConnectionHandler* i_handler)
+    // events that still need to be processed and whether a thread is processing them right now
+    std::atomic<int> pending_events{0};
+    std::atomic<bool> active{false};
+
+    // the connection whose IO is handled by the calling thread
+    static inline thread_local Pimpl* current{nullptr};
+
+    Pimpl(ClientSocket i_con, Epoll& i_epoll, Dispatcher& i_dispatcher, ServerOptions const& i_options, FileReader* i_file_reader, ConnectionHandler* i_handler)
+      : con{std::move(i_con)}
+      , epoll{i_epoll}
+      , dispatcher{i_dispatcher}
+      , options{i_options}
+      , wakeup{std::make_shared<Wakeup>()}
+      , file_reader{i_file_reader}
+      , protocol{std::make_unique<HttpProtocol>(i_handler)}
+    {
+        wakeup->fd = con;
+        wakeup->flags = epollFlags(options.io_mode);
+        epoll.addFD(wakeup->event_fd, [wakeup=wakeup, &epoll=epoll](int) {
+            std::uint64_t count;
+            while (::read(wakeup->event_fd, &count, sizeof(count)) > 0) {
+            }
+            wakeup->pending = false;
+            // let the IO loop pick up the queued jobs
+            // (modifying an edge triggered registration reports the current readiness again)
+            std::lock_guard lock{wakeup->mutex};
+            if (wakeup->fd >= 0) {
+                epoll.modFD(wakeup->fd, wakeup->flags | EPOLLOUT);
+            }
+        }, EPOLLIN|EPOLLET, "cndl::wakeup");
+        setupIdle();
+    }
+
+    Pimpl(ClientSocket i_con, Epoll& i_epoll, Dispatcher& i_dispatcher, ServerOptions const& i_options, FileReader* i_file_reader, ConnectionHandler* i_handler, UringLoop& i_ring, std::uint64_t i_ring_id)
       : con{std::move(i_con)}
       , epoll{i_epoll}
       , dispatcher{i_dispatcher}
+      , options{i_options}
+      , file_reader{i_file_reader}
+      , ring{&i_ring}
+      , ring_id{i_ring_id}
       , protocol{std::make_unique<HttpProtocol>(i_handler)}
-    {}
+    {
+        setupIdle();
+    }
+
+    ~Pimpl() {
+        if (wakeup and con.valid()) {
+            epoll.rmFD(wakeup->event_fd, false);
+        }
+        release_buffer(std::move(in_buf));
+    }
+
+    void write(Payload out, AfterSentCB on_after_sent) {
+        touch();
+        outBufferSize += payload_size(out);
+        auto job = TransmitJob(std::move(out), 0U, std::move(on_after_sent));
+        if (current == this) {
+            // we are on the IO loop of this connection, try to send right away
+            take_queued_jobs();
+            transmit_jobs.emplace_back(std::move(job));
+            flush();
+            return;
+        }
+        write_queue.push(std::move(job));
+        kick();
+    }
+
+    // lets the IO loop flush this connection (can be called from any thread)
+    // returns a callable that does the same and stays valid even if the connection goes away
+    auto kicker() {
+        return [ring=ring, ring_id=ring_id, wakeup=wakeup] {
+            if (ring) {
+                ring->schedule(ring_id);
+            } else if (not wakeup->pending.exchange(true)) {
+                std::uint64_t one{1};
+                [[maybe_unused]] auto w = ::write(wakeup->event_fd, &one, sizeof(one));
+            }
+        };
+    }
+
+    void kick() {
+        kicker()();
+    }
+
+    void setupIdle() {
+        if (options.idle_reclaim_after.count() == 0) {
+            return;
+        }
+        idle = std::make_shared<IdleState>();
+        idle->options = &options;
+        idle->kick = kicker();
+    }
+
+    void pauseReceiving() {
+        if (receive_paused) {
+            return;
+        }
+        receive_paused = true;
+        if (ring) {
+            ring->pauseRecv(ring_id);
+        }
+    }
+
+    unique_func<void()> receiveResumer() {
+        return [resume_pending=resume_pending, kick=kicker()] {
+            *resume_pending = true;
+            kick();
+        };
+    }
+
+    // picks up a resume request, returns whether receiving was paused and has been resumed
+    bool takeResume() {
+        if (not resume_pending->exchange(false) or not receive_paused) {
+            return false;
+        }
+        receive_paused = false;
+        if (ring) {
+            ring->resumeRecv(ring_id);
+        }
+        return true;
+    }
+
+    // records activity (from any thread), the connection is looked at by the next idle sweeps
+    void touch() {
+        if (not idle) {
+            return;
+        }
+        idle->last_active.store(IdleState::Clock::now(), std::memory_order_relaxed);
+        list();
+    }
+
+    void list() {
+        if (not idle->listed.exchange(true)) {
+            auto& connections = idle_connections();
+            std::lock_guard lock{connections.mutex};
+            connections.states.emplace_back(idle);
+        }
+    }
+
+    // picks up a reclaim request of the idle sweep
+    void takeReclaim() {
+        if (not idle or not idle->reclaim.exchange(false)) {
+            return;
+        }
+        if (IdleState::Clock::now() - idle->last_active.load(std::memory_order_relaxed) < options.idle_reclaim_after) {
+            // something happened after the sweep looked at this connection
+            list();
+            return;
+        }
+        reclaimMemory();
+    }
+
+    // gives back the buffers that are only kept for the next burst of data (called from the IO loop)
+    void reclaimMemory() {
+        if (in_buf.empty()) {
+            release_buffer(std::exchange(in_buf, {}));
+        }
+        if (transmit_jobs.empty()) {
+            transmit_jobs.shrink_to_fit();
+        }
+        in_flight.shrink_to_fit();
+        if (protocol) {
+            protocol->reclaimMemory();
+        }
+    }
+
+    // makes sure that the job at idx can be sent by the current backend
+    // file regions are sent with sendfile from the IO loop unless that could block on the disk (or if we are on io_uring)
+    // otherwise the next chunk of the region is read by the file_reader (or right away) and put in front of it, in memory
+    // returns false if the job cannot be sent yet (i.e., the next chunk is still being read)
+    bool prepare(std::size_t idx) {
+        auto& [payload, bytes_sent, cb] = transmit_jobs[idx];
+        auto* region = std::get_if<FileRegion>(&payload);
+        if (not region or (not ring and not file_reader) or bytes_sent != 0) {
+            // a region that sendfile already started on is finished by sendfile
+            return true;
+        }
+
+        ByteBuf chunk;
+        if (pending_read) {
+            if (not pending_read->done) {
+                return false;
+            }
+            chunk = std::move(pending_read->data);
+            pending_read.reset();
+        } else {
+            auto length = std::min(region->length, file_chunk_size);
+            if (not ring and in_page_cache(region->fd, region->offset, length)) {
+                // sendfile will not block, which saves copying the chunk around
+                if (length < region->length) {
+                    auto head = *region;
+                    head.length = length;
+                    region->offset += length;
+                    region->length -= length;
+                    transmit_jobs.insert(begin(transmit_jobs) + idx, TransmitJob{std::move(head), 0U, AfterSentCB{}});
+                }
+                return true;
+            }
+            ssize_t r{-1};
+            if (ring) {
+                chunk = acquire_buffer(length);
+                chunk.resize(length);
+                // if the data is in the page cache there is no need to bother the file_reader
+                iovec iov{chunk.data(), chunk.size()};
+                r = ::preadv2(region->fd, &iov, 1, region->offset, file_reader ? RWF_NOWAIT : 0);
+            }
+            // not every file system supports RWF_NOWAIT, whatever went wrong the file_reader will find out for sure
+            if (r < 0 and file_reader) {
+                release_buffer(std::move(chunk));
+                pending_read = std::make_shared<PendingRead>();
+                file_reader->read(*region, length, [pending=pending_read, kick=kicker()](ByteBuf data) {
+                    pending->data = std::move(data);
+                    pending->done = true;
+                    kick();
+                });
+                return false;
+            }
+            chunk.resize(std::max<ssize_t>(r, 0));
+        }
 
-    void write(ByteBuf out_buf, AfterSentCB on_after_sent) {
-        auto job = TransmitJob(std::move(out_buf), 0U, std::move(on_after_sent));
-        std::lock_guard lock{transmit_job_mutex};
-        if (not transmit_jobs.empty() || not flush_job(job, con)) {
-            // update buffer size
-            auto const& [out_buf, bytes_sent, cb] = job;
-            outBufferSize += out_buf.size() - bytes_sent;
+        if (chunk.empty()) {
+            // the file shrank, the response cannot be completed anymore
+            close(false);
+            return false;
+        }
+        if (chunk.size() < region->length) {
+            region->offset += chunk.size();
+            region->length -= chunk.size();
+            transmit_jobs.insert(begin(transmit_jobs) + idx, TransmitJob{std::move(chunk), 0U, AfterSentCB{}});
+        } else {
+            std::get<0>(transmit_jobs[idx]) = std::move(chunk);
+        }
+        return true;
+    }
 
-            // queue job
+    void take_queued_jobs() {
+        write_queue.consume([this](TransmitJob&& job) {
             transmit_jobs.emplace_back(std::move(job));
-            // send when the socket is ready
-            epoll.modFD(con, EPOLLIN|EPOLLOUT|EPOLLHUP|EPOLLRDHUP|EPOLLONESHOT);
+        });
+    }
+
+    void flush() {
+        take_queued_jobs();
+        if (ring) {
+            // only one chain of sends may be in flight, otherwise the kernel could reorder them
+            if (con.valid() and in_flight.empty() and not transmit_jobs.empty()) {
+                auto count = std::min(transmit_jobs.size(), ring->maxChainLength());
+                for (std::size_t i{0}; i < count; ++i) {
+                    if (not prepare(i)) {
+                        count = i;
+                        break;
+                    }
+                }
+                if (count == 0 or not con.valid()) {
+                    return;
+                }
+                std::move(begin(transmit_jobs), begin(transmit_jobs) + count, std::back_inserter(in_flight));
+                transmit_jobs.erase(begin(transmit_jobs), begin(transmit_jobs) + count);
+                ring->send(ring_id, in_flight);
+            }
+            return;
+        }
+        std::size_t done{0};
+        while (con.valid() and done < transmit_jobs.size() and prepare(done)) {
+            auto& job = transmit_jobs[done];
+            // update buffer size and flush
+            auto size = payload_size(std::get<0>(job));
+            auto to_send = size - std::get<1>(job);
+            auto result = flush_job(job, con, done+1 < transmit_jobs.size());
+            auto remaining = size - std::get<1>(job);
+
+            outBufferSize -= to_send - remaining;
+            if (result == FlushResult::failed) {
+                close(false);
+                break;
+            }
+            if (result == FlushResult::would_block) {
+                break;
+            }
+            release_payload(std::move(std::get<0>(job)));
+            ++done;
         }
+        transmit_jobs.erase(begin(transmit_jobs), begin(transmit_jobs) + done);
     }
 
     void operator()(int flags) {
+        pending_events |= flags;
+        // only one thread at a time handles the IO of a connection
+        // if another thread is already at it, it will process the events we just added
+        while (pending_events != 0) {
+            if (active.exchange(true)) {
+                return;
+            }
+            auto* previous = std::exchange(current, this);
+            while (int events = pending_events.exchange(0)) {
+                process(events);
+            }
+            rearm();
+            current = previous;
+            active = false;
+        }
+    }
+
+    void process(int flags) {
+        if (not con.valid()) {
+            return;
+        }
         if (flags & (EPOLLERR|EPOLLHUP|EPOLLRDHUP)) {
             if (protocol) {
                 protocol->onPeerClose();
@@ -68,73 +485,162 @@ struct ConnectionHandler::Pimpl {
             close(false);
             return;
         }
-        int mod_flags = EPOLLIN|EPOLLHUP|EPOLLRDHUP|EPOLLONESHOT;
 
-        if ((flags & EPOLLIN) and protocol) {
+        bool resumed = takeResume();
+        if (((flags & EPOLLIN) or resumed) and protocol and not receive_paused) {
+            if (in_buf.capacity() == 0) {
+                in_buf = acquire_buffer(read_size);
+            }
             while (true) {
-                constexpr int read_size = 4096;
                 auto head = in_buf.size();
                 in_buf.resize(head+read_size);
                 int r = ::recv(con, in_buf.data()+head, read_size, 0);
-                if (r < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+                if (r <= 0) {
+                    // EAGAIN: drained the socket; 0: the peer hung up which is reported as EPOLLRDHUP
                     in_buf.resize(head);
                     break;
                 }
                 in_buf.resize(head+r);
-                if (r < read_size) {
+                // in edge triggered mode we get no further notification until the socket has been drained
+                if (r < read_size and options.io_mode != IOMode::edge_triggered) {
                     break;
                 }
             }
-            auto [consumed, prot_change] = protocol->onDataReceived(ProtocolHandler::ByteView{in_buf.data(), in_buf.size()});
-            in_buf.erase(begin(in_buf), begin(in_buf)+consumed);
+            feed({in_buf.data(), in_buf.size()}, true);
+        }
 
-            if (prot_change) {
-                protocol = std::move(*prot_change);
-            }
+        if (con.valid()) {
+            flush();
+            takeReclaim();
         }
+        closeIfDone();
+    }
 
-        if (flags & EPOLLOUT) {
-            std::lock_guard lock{transmit_job_mutex};
-            bool sent_something = false;
-            while (not transmit_jobs.empty()) {
-                auto job = transmit_jobs.begin();
+    // hand received data to the protocol
+    // data is either the content of in_buf or a buffer owned by the caller (whose unconsumed remainder is kept in in_buf)
+    void feed(ByteView data, bool from_in_buf) {
+        touch();
+        auto [consumed, prot_change] = protocol->onDataReceived(data);
+        if (from_in_buf) {
+            in_buf.erase(begin(in_buf), begin(in_buf)+consumed);
+        } else {
+            in_buf.insert(end(in_buf), data.begin()+consumed, data.end());
+        }
 
-                // update buffer size and flush
-                auto to_send = std::get<0>(*job).size() - std::get<1>(*job);
-                bool job_sent = flush_job(*job, con);
-                auto remaining = std::get<0>(*job).size() - std::get<1>(*job);
+        if (prot_change) {
+            protocol = std::move(*prot_change);
+        }
+    }
 
-                outBufferSize -= to_send - remaining;
+    void closeIfDone() {
+        // if there is nothing to send and no protocol to listen (i.e., when we have flushed all data) bail out
+        // the protocol could change during the handling of a callback
+        if (con.valid() and not protocol and transmit_jobs.empty() and in_flight.empty() and write_queue.empty()) {
+            close(false);
+        }
+    }
 
-                sent_something |= job_sent;
-                if (not job_sent) {
-                    break;
-                }
-                transmit_jobs.erase(job);
+    // completion based IO, called by the UringLoop
+    void onReceived(ByteView data) {
+        auto* previous = std::exchange(current, this);
+        if (receive_paused) {
+            // the receive is being cancelled, whatever still arrives waits until the protocol wants it
+            in_buf.insert(end(in_buf), data.begin(), data.end());
+        } else if (protocol) {
+            if (in_buf.empty()) {
+                feed(data, false);
+            } else {
+                in_buf.insert(end(in_buf), data.begin(), data.end());
+                feed({in_buf.data(), in_buf.size()}, true);
             }
+        }
+        flush();
+        closeIfDone();
+        current = previous;
+    }
+
+    void onSent(int result) {
+        auto* previous = std::exchange(current, this);
+        auto job = std::move(in_flight.front());
+        in_flight.pop_front();
 
-            // if there is nothing to send and no protocol to listen (i.e., when we have flushed all data) bail out
-            // the protocol could change during the handling of a callback
-            if (not protocol) { 
+        auto& [payload, bytes_sent, cb] = job;
+        outBufferSize -= payload_size(payload) - bytes_sent;
+        if (result < 0) {
+            // the send failed or was cancelled because an earlier link in its chain failed
+            if (con.valid()) {
                 close(false);
             }
+        } else if (cb) {
+            cb();
         }
+        release_payload(std::move(payload));
+        if (in_flight.empty()) {
+            flush();
+        }
+        closeIfDone();
+        current = previous;
+    }
 
-        {
-            std::lock_guard lock{transmit_job_mutex};
-            if (not transmit_jobs.empty()) {
-                mod_flags |= EPOLLOUT;
-            }
+    void onWakeup() {
+        auto* previous = std::exchange(current, this);
+        if (takeResume() and protocol and not in_buf.empty()) {
+            feed({in_buf.data(), in_buf.size()}, true);
         }
+        flush();
+        takeReclaim();
+        closeIfDone();
+        current = previous;
+    }
 
+    void onPeerClose() {
+        auto* previous = std::exchange(current, this);
+        if (protocol) {
+            protocol->onPeerClose();
+        }
         if (con.valid()) {
+            close(false);
+        }
+        current = previous;
+    }
+
+    void rearm() {
+        if (not con.valid()) {
             // up to here con might have been closed (and thus deregistered from epoll)
             // we only need to rearm the epoll handle if the connection is still open
-            epoll.modFD(con, mod_flags);
+            return;
+        }
+        if (options.io_mode == IOMode::edge_triggered) {
+            // we are notified of every new edge without rearming
+            // (unsent jobs are flushed on the next EPOLLOUT edge, queued ones trigger the wakeup)
+            return;
+        }
+        int mod_flags = epollFlags(options.io_mode);
+        if (receive_paused) {
+            mod_flags &= ~EPOLLIN;
+        }
+        if (not transmit_jobs.empty() or not write_queue.empty()) {
+            mod_flags |= EPOLLOUT;
+        }
+        wakeup->flags = mod_flags;
+        epoll.modFD(con, mod_flags);
+        // a job (or a resume) that was queued after the checks above would be lost if the wakeup rearmed con before we did
+        if (not (mod_flags & EPOLLOUT) and (not write_queue.empty() or (receive_paused and *resume_pending))) {
+            epoll.modFD(con, mod_flags|EPOLLOUT);
         }
     }
 
     void close(bool blocking) {
+        if (ring) {
+            ring->close(ring_id);
+            con.close();
+            return;
+        }
+        {
+            std::lock_guard lock{wakeup->mutex};
+            wakeup->fd = -1;
+        }
+        epoll.rmFD(wakeup->event_fd, blocking);
         epoll.rmFD(con, blocking);
         con.close();
     }
@@ -147,13 +653,17 @@ struct ConnectionHandler::Pimpl {
         return dispatcher;
     }
 
+    ServerOptions const& getOptions() const {
+        return options;
+    }
+
     Epoll& getIOLoop() {
         return epoll;
     }
 };
 
-void ConnectionHandler::write(ByteBuf out_buf, AfterSentCB on_after_sent) {
-    pimpl->write(std::move(out_buf), std::move(on_after_sent));
+void ConnectionHandler::write(Payload out, AfterSentCB on_after_sent) {
+    pimpl->write(std::move(out), std::move(on_after_sent));
 }
 
 void ConnectionHandler::close(bool blocking) {
@@ -164,22 +674,85 @@ size_t ConnectionHandler::getOutBufferSize() const {
 }
 
 
+void ConnectionHandler::reclaimIdle(ServerOptions const& options) {
+    auto now = IdleState::Clock::now();
+    auto& connections = idle_connections();
+    std::lock_guard lock{connections.mutex};
+    std::erase_if(connections.states, [&](std::weak_ptr<IdleState> const& weak) {
+        auto state = weak.lock();
+        if (not state) {
+            return true;
+        }
+        if (state->options != &options or now - state->last_active.load(std::memory_order_relaxed) < options.idle_reclaim_after) {
+            return false;
+        }
+        // listed is cleared first so that activity from here on lists the connection again
+        state->listed = false;
+        state->reclaim = true;
+        state->kick();
+        return true;
+    });
+}
+
+void ConnectionHandler::pauseReceiving() {
+    pimpl->pauseReceiving();
+}
+
+unique_func<void()> ConnectionHandler::receiveResumer() {
+    return pimpl->receiveResumer();
+}
+
 Dispatcher& ConnectionHandler::getDispatcher() {
     return pimpl->getDispatcher();
 }
 
+ServerOptions const& ConnectionHandler::getOptions() const {
+    return pimpl->getOptions();
+}
+
+int ConnectionHandler::epollFlags(IOMode mode) {
+    if (mode == IOMode::edge_triggered) {
+        return EPOLLIN|EPOLLOUT|EPOLLHUP|EPOLLRDHUP|EPOLLET;
+    }
+    return EPOLLIN|EPOLLHUP|EPOLLRDHUP|EPOLLONESHOT;
+}
+
 ConnectionHandler::Epoll& ConnectionHandler::getIOLoop() {
     return pimpl->getIOLoop();
 }
 
 void ConnectionHandler::operator()(int flags) {
-    (*pimpl)(flags);
+    // edge triggered registrations can be reported to several threads at once, the one that closes the connection
+    // removes this handler from epoll while the others may still be in here, they keep the state alive until they left
+    auto keep_alive = pimpl;
+    (*keep_alive)(flags);
 }
 
-ConnectionHandler::ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher)
-  : pimpl{std::make_unique<Pimpl>(std::move(cs), load_balancer, dispatcher, this)}
+// short lived connections (health checks, HTTP/1.0 clients) come and go at a high rate, their state is recycled
+ConnectionHandler::ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher, ServerOptions const& options, FileReader* file_reader)
+  : pimpl{std::allocate_shared<Pimpl>(FreeListAllocator<Pimpl>{}, std::move(cs), load_balancer, dispatcher, options, file_reader, this)}
+{}
+
+ConnectionHandler::ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher, ServerOptions const& options, FileReader* file_reader, UringLoop& ring, std::uint64_t id)
+  : pimpl{std::allocate_shared<Pimpl>(FreeListAllocator<Pimpl>{}, std::move(cs), load_balancer, dispatcher, options, file_reader, this, ring, id)}
 {}
 
+void ConnectionHandler::onReceived(ByteView data) {
+    pimpl->onReceived(data);
+}
+
+void ConnectionHandler::onSent(int result) {
+    pimpl->onSent(result);
+}
+
+void ConnectionHandler::onWakeup() {
+    pimpl->onWakeup();
+}
+
+void ConnectionHandler::onPeerClose() {
+    pimpl->onPeerClose();
+}
+
 ConnectionHandler::ConnectionHandler(ConnectionHandler&& rhs) noexcept
   : pimpl{std::move(rhs.pimpl)}
 {
@@ -1,29 +1,40 @@
 #pragma once
 
+#include "Payload.h"
+#include "ServerOptions.h"
 #include "unique_function.h"
 
 #include <simplyfile/Epoll.h>
 #include <simplyfile/socket/Socket.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace cndl {
 
 struct ProtocolHandler;
 struct Dispatcher;
+struct UringLoop;
+struct FileReader;
 
 struct ConnectionHandler {
     using ClientSocket = simplyfile::ClientSocket;
     using Epoll = simplyfile::Epoll;
-    using ByteBuf = std::vector<std::byte>;
+    using ByteBuf = cndl::ByteBuf;
+    using Payload = cndl::Payload;
     using ByteView = std::basic_string_view<std::byte>;
     using AfterSentCB = unique_func<void()>;
-    using TransmitJob = std::tuple<ByteBuf, std::size_t, AfterSentCB>;
+    using TransmitJob = std::tuple<Payload, std::size_t, AfterSentCB>;
 
-    ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher);
+    // file regions are read by the file_reader's threads if one is given, otherwise they are sent with sendfile
+    ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher, ServerOptions const& options, FileReader* file_reader=nullptr);
+
+    // the epoll flags a connection socket has to be registered with
+    static int epollFlags(IOMode mode);
     ~ConnectionHandler();
 
     ConnectionHandler(ConnectionHandler&&) noexcept;
@@ -32,20 +43,43 @@ struct ConnectionHandler {
     // IO is handled here
     void operator()(int flags);
 
-    // try to send out_buf immediately and  enqueue the unsent remainder the write_queue of this connection handler
-    // when the transmission is done on_after_sent will be called
-    void write(ByteBuf out_buf, AfterSentCB on_after_sent={});
+    // when called from the IO loop of this connection out_buf is sent immediately and the unsent remainder is enqueued
+    // when called from any other thread out_buf is enqueued and the IO loop is woken up to send it (write never blocks on the socket)
+    // when the transmission is done on_after_sent will be called (from the IO loop)
+    // shared buffers and file regions are sent as they are, without being copied
+    void write(Payload out, AfterSentCB on_after_sent={});
 
     void close(bool blocking); // closes the underlying socket and removes it from the IO loop
 
     size_t getOutBufferSize() const;
 
+    // flow control for the protocol: nothing is received (and fed to the protocol) until the connection is resumed
+    // pauseReceiving has to be called from the IO loop of this connection
+    void pauseReceiving();
+    // returns a callable that resumes receiving, it can be called from any thread and stays valid even if the connection goes away
+    unique_func<void()> receiveResumer();
+
+    // lets the connections created with options that have neither received nor sent anything for options.idle_reclaim_after
+    // give back their buffers (the Server calls this periodically), the buffers are released by the IO loops of the connections
+    static void reclaimIdle(ServerOptions const& options);
+
     Dispatcher& getDispatcher();
 
+    ServerOptions const& getOptions() const;
+
     Epoll& getIOLoop();
 private:
+    // connections whose IO is done through io_uring are created and fed by the UringLoop
+    friend struct UringLoop;
+    ConnectionHandler(ClientSocket cs, Epoll& load_balancer, Dispatcher& dispatcher, ServerOptions const& options, FileReader* file_reader, UringLoop& ring, std::uint64_t id);
+    void onReceived(ByteView data);
+    void onSent(int result);
+    void onWakeup();
+    void onPeerClose();
+
     struct Pimpl;
-    std::unique_ptr<Pimpl> pimpl;
+    // shared with the threads that are handling IO of the connection (see operator())
+    std::shared_ptr<Pimpl> pimpl;
 };
 
 
@@ -0,0 +1,69 @@
+#include "ContentEncoding.h"
+#include "HeaderFields.h"
+
+#include <algorithm>
+#include <optional>
+
+#include <zlib.h>
+
+namespace cndl {
+
+bool accepts_encoding(std::string_view accept_encoding, std::string_view coding) {
+    std::optional<bool> wildcard;
+    while (not accept_encoding.empty()) {
+        auto comma = accept_encoding.find(',');
+        auto item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+
+        auto semicolon = item.find(';');
+        auto name = detail::trim(item.substr(0, semicolon));
+        bool acceptable = true;
+        if (semicolon != std::string_view::npos) {
+            // q=0 (or 0.0, 0.00...) rules the coding out
+            auto param = detail::trim(item.substr(semicolon + 1));
+            if (param.size() > 2 and (param[0] == 'q' or param[0] == 'Q') and param[1] == '=') {
+                auto q = param.substr(2);
+                acceptable = q.find_first_not_of("0.") != std::string_view::npos;
+            }
+        }
+        if (detail::ignore_case_equal(name, coding)) {
+            return acceptable;
+        }
+        if (name == "*") {
+            wildcard = acceptable;
+        }
+    }
+    return wildcard.value_or(false);
+}
+
+bool is_compressible(std::string_view content_type) {
+    constexpr std::array<std::string_view, 5> compressible_types {
+        "application/javascript", "application/json", "application/xml", "application/wasm", "image/svg+xml"
+    };
+    return content_type.starts_with("text/")
+        or content_type.ends_with("+xml")
+        or std::find(begin(compressible_types), end(compressible_types), content_type) != end(compressible_types);
+}
+
+ByteBuf gzip_compress(std::span<std::byte const> in) {
+    z_stream stream{};
+    // 15 window bits + 16 selects the gzip container instead of the zlib one
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return {};
+    }
+    ByteBuf out(deflateBound(&stream, in.size()));
+    stream.next_in   = reinterpret_cast<Bytef*>(const_cast<std::byte*>(in.data()));
+    stream.avail_in  = static_cast<uInt>(in.size());
+    stream.next_out  = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        return {};
+    }
+    out.shrink_to_fit();
+    return out;
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Payload.h"
+
+#include <array>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace cndl {
+
+// the encoding and the extension of precompressed files, in order of preference
+inline constexpr std::array<std::pair<std::string_view, std::string_view>, 2> precompressed_siblings {{
+    {"br", ".br"},
+    {"gzip", ".gz"},
+}};
+
+// whether coding is acceptable according to the (comma separated) Accept-Encoding values
+bool accepts_encoding(std::string_view accept_encoding, std::string_view coding);
+
+// text formats shrink a lot, most binary formats are compressed already
+bool is_compressible(std::string_view content_type);
+
+// content in the gzip format, empty if compressing failed
+ByteBuf gzip_compress(std::span<std::byte const> in);
+
+// whether compressed is small enough compared to the original to be worth sending instead
+inline bool worth_compressing(std::size_t original, std::size_t compressed) {
+    return compressed != 0 and compressed <= original / 10 * 9;
+}
+
+}
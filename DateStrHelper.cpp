@@ -11,6 +11,42 @@ namespace cndl {
 
 namespace {
 constexpr auto date_format_string = "%a, %d %b %Y %H:%M:%S %Z"sv;
+
+// "Sun, 06 Nov 1994 08:49:37 GMT"
+using HttpDate = std::array<char, 29>;
+
+void put2(char* out, int value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+// strftime is locale aware and looks up the timezone, an http date needs neither
+void format_http_date(time_t t, HttpDate& out) {
+    constexpr std::string_view days   = "SunMonTueWedThuFriSat";
+    constexpr std::string_view months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    auto* p = out.data();
+    days.copy(p, 3, tm.tm_wday * 3);
+    p[3] = ',';
+    p[4] = ' ';
+    put2(p + 5, tm.tm_mday);
+    p[7] = ' ';
+    months.copy(p + 8, 3, tm.tm_mon * 3);
+    p[11] = ' ';
+    int year = tm.tm_year + 1900;
+    put2(p + 12, (year / 100) % 100);
+    put2(p + 14, year % 100);
+    p[16] = ' ';
+    put2(p + 17, tm.tm_hour);
+    p[19] = ':';
+    put2(p + 20, tm.tm_min);
+    p[22] = ':';
+    put2(p + 23, tm.tm_sec);
+    " GMT"sv.copy(p + 25, 4);
+}
+
 }
 
 std::string mkdatestr(struct tm const& tm) {
@@ -20,9 +56,23 @@ std::string mkdatestr(struct tm const& tm) {
 }
 
 std::string mkdatestr(struct timespec const& ts) {
-    struct tm tm;
-    localtime_r(&ts.tv_sec, &tm);
-    return mkdatestr(tm);
+    HttpDate date;
+    format_http_date(ts.tv_sec, date);
+    return std::string(date.data(), date.size());
+}
+
+std::string_view current_datestr() {
+    thread_local time_t cached_second{-1};
+    thread_local HttpDate cached_date;
+
+    // the coarse clock is read without a syscall and is precise enough for a resolution of one second
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != cached_second) {
+        format_http_date(now.tv_sec, cached_date);
+        cached_second = now.tv_sec;
+    }
+    return {cached_date.data(), cached_date.size()};
 }
 
 struct tm parsedatestr(std::string_view str) {
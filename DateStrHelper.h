@@ -8,8 +8,13 @@
 namespace cndl {
 
 std::string mkdatestr(struct tm const& tm);
+// formats ts as an RFC 7231 date (always in GMT)
 std::string mkdatestr(struct timespec const& ts);
 
+// the current time as RFC 7231 date, formatted at most once per second and thread
+// the view is valid until the next call on the same thread
+std::string_view current_datestr();
+
 struct tm parsedatestr(std::string_view str);
 
-}
\ No newline at end of file
+}
@@ -1,56 +1,169 @@
 #include "Dispatcher.h"
 
+#include <algorithm>
+#include <array>
 #include <mutex>
+#include <tuple>
 #include <vector>
 #include <ranges>
 
 namespace cndl {
 
+namespace {
+
+// routes are indexed by the methods they take, a method is interned as its position in here (others as other_methods)
+constexpr std::array<std::string_view, 9> known_methods{"GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS", "CONNECT", "TRACE"};
+constexpr std::size_t get_method     = 0;
+constexpr std::size_t head_method    = 1;
+constexpr std::size_t options_method = 6;
+constexpr std::size_t other_methods  = known_methods.size();
+
+std::size_t method_index(std::string_view method) {
+    return std::find(begin(known_methods), end(known_methods), method) - begin(known_methods);
+}
+
+int match_score(Request const& request, std::cmatch const& match) {
+    int score = request.header.resource.size();
+    for (auto sub_m : match | std::views::drop(1)) {
+        score -= sub_m.length();
+    }
+    return score;
+}
+
+// the route whose pattern matches most of the resource literally
+template<typename RouteT, typename Filter>
+std::pair<RouteT*, std::cmatch> best_match(std::vector<RouteT*> const& routes, Request const& request, Filter filter) {
+    RouteT* best_route{};
+    std::cmatch best;
+    int best_score{};
+    for (auto* r : routes) {
+        if (not filter(*r)) {
+            continue;
+        }
+        auto match = r->match(request);
+        if (not match) {
+            continue;
+        }
+        auto score = match_score(request, *match);
+        if (not best_route or score > best_score) {
+            best_route = r;
+            best = *match;
+            best_score = score;
+        }
+    }
+    return {best_route, best};
+}
+
+}
+
 struct Dispatcher::Pimpl {
     ErrorBodyGenerator error_body_generator;
-    // method -> handler
+    // all routes and the routes per interned method (see method_index), the last ones take methods that are not known_methods
     std::vector<RouteBase*> routes;
+    std::array<std::vector<RouteBase*>, other_methods+1> routes_by_method;
     std::mutex routes_mutex;
 
     std::vector<WSRouteBase*> ws_routes;
     std::mutex ws_mutex;
 
+    std::vector<StreamRouteBase*> stream_routes;
+    std::mutex stream_mutex;
+
     Pimpl(ErrorBodyGenerator generator)
       : error_body_generator{std::move(generator)}
     {}
-};
 
-Response Dispatcher::route(Request const& request) noexcept {
-    std::lock_guard lock{pimpl->routes_mutex};
-    struct URLMatchInfo {
-        std::cmatch match{};
+    struct Found {
         RouteBase* route{};
-        int score{};
+        std::cmatch match{};
+        // if there is no route: whether a route that does not take the method matches the resource (405 rather than 404)
+        bool resource_matched{false};
     };
-    std::vector<URLMatchInfo> match_infos;
 
-    for (auto* r : pimpl->routes) {
-        auto match = r->match(request);
-        if (not match) {
-            continue;
+    // the route for request among those that take its method, HEAD requests go to GET routes unless a route takes HEAD itself
+    Found find(Request const& request) const {
+        auto const& method = request.header.method;
+        auto index = method_index(method);
+        auto [route, match] = best_match(routes_by_method[index], request, [&](RouteBase const& r) {
+            return index != other_methods or r.allowsMethod(method);
+        });
+        if (not route and index == head_method) {
+            std::tie(route, match) = best_match(routes_by_method[get_method], request, [](auto const&) { return true; });
         }
-        int score = request.header.resource.size();
-        for (auto sub_m : *match | std::views::drop(1)) {
-            score -= sub_m.length();
+        if (route) {
+            return {route, std::move(match)};
         }
-        match_infos.emplace_back(URLMatchInfo{
-            .match = *match,
-            .route = r,
-            .score = score
+        // every route is matched at most once, those that were tried above are skipped
+        bool resource_matched = std::any_of(begin(routes), end(routes), [&](RouteBase const* r) {
+            bool tried = r->allowsMethod(method) or (index == head_method and r->allowsMethod(known_methods[get_method]));
+            return not tried and r->match(request);
         });
+        return {nullptr, {}, resource_matched};
+    }
+
+    // the value of an Allow header for the resource of request (the methods of all routes that match it), empty if no route does
+    std::string allowed(Request const& request) const {
+        std::array<bool, other_methods> known{};
+        std::vector<std::string_view> others;
+        bool matched = false;
+        for (auto* r : routes) {
+            if (not r->match(request)) {
+                continue;
+            }
+            matched = true;
+            for (auto const& method : r->getOptions().methods) {
+                if (auto index = method_index(method); index != other_methods) {
+                    known[index] = true;
+                } else if (std::find(begin(others), end(others), method) == end(others)) {
+                    others.emplace_back(method);
+                }
+            }
+        }
+        if (not matched) {
+            return {};
+        }
+        // GET routes serve HEAD and OPTIONS is answered by the dispatcher
+        known[head_method] = known[head_method] or known[get_method];
+        known[options_method] = true;
+        std::string allow;
+        for (std::size_t i{0}; i < other_methods; ++i) {
+            if (known[i]) {
+                allow += (allow.empty() ? "" : ", ") + std::string{known_methods[i]};
+            }
+        }
+        for (auto method : others) {
+            allow += ", " + std::string{method};
+        }
+        return allow;
     }
 
-    auto best_route = std::max_element(begin(match_infos), end(match_infos), [](auto const& l, auto const& r) { return l.score < r.score; });
-    if (best_route == match_infos.end()) {
-        return Response{404, pimpl->error_body_generator};
+    // the answer to a request that no route takes (see find): 404 if no route matches its resource at all
+    // otherwise OPTIONS is answered with the methods of the routes that match it and any other method with 405
+    Response unrouted(Request const& request, Found const& found) const {
+        if (not found.resource_matched) {
+            return Response{Status{404}, error_body_generator};
+        }
+        Response response;
+        if (request.header.method == "OPTIONS") {
+            response.status_code = 204;
+            response.fields.erase(Field::content_type);
+        } else {
+            response = Response{Status{405}, error_body_generator};
+        }
+        response.fields.emplace("Allow", allowed(request));
+        return response;
+    }
+};
+
+
+Response Dispatcher::route(Request const& request) noexcept {
+    std::lock_guard lock{pimpl->routes_mutex};
+    auto found = pimpl->find(request);
+    if (not found.route) {
+        return pimpl->unrouted(request, found);
     }
     try {
-        auto resp = (*best_route->route)(request, best_route->match);
+        auto resp = (*found.route)(request, found.match);
         if (resp) {
             return *resp;
         }
@@ -61,30 +174,76 @@ Response Dispatcher::route(Request const& request) noexcept {
     } catch (...) {
         return Error{500, "uncaught error"};
     }
-    return Response{404, pimpl->error_body_generator};
+    return Response{Status{404}, pimpl->error_body_generator};
 }
 
-WSRouteBase& Dispatcher::routeWS(Request const& request) {
+WSRouteBase* Dispatcher::routeWS(Request const& request) {
     std::lock_guard lock{pimpl->ws_mutex};
     for (auto* r : pimpl->ws_routes) {
         auto accept = r->canOpen(request);
         if (accept) {
-            return *r;
+            return r;
         }
     }
-    throw Error{404};
+    return nullptr;
+}
+
+std::optional<Status> Dispatcher::canAccept(Request const& request) {
+    std::lock_guard lock{pimpl->routes_mutex};
+    auto found = pimpl->find(request);
+    if (found.route) {
+        return found.route->canAccept(request);
+    }
+    if (not found.resource_matched) {
+        return Status{404};
+    }
+    if (request.header.method == "OPTIONS") {
+        return std::nullopt;
+    }
+    return Status{405};
+}
+
+std::string Dispatcher::allowedMethods(Request const& request) {
+    std::lock_guard lock{pimpl->routes_mutex};
+    return pimpl->allowed(request);
+}
+
+Expected<std::unique_ptr<BodyReader>> Dispatcher::openStream(Request const& request) {
+    std::lock_guard lock{pimpl->stream_mutex};
+    auto [best_route, match] = best_match(pimpl->stream_routes, request, [&](StreamRouteBase const& r) {
+        auto const& methods = r.getOptions().methods;
+        return std::find(begin(methods), end(methods), request.header.method) != end(methods);
+    });
+    if (not best_route) {
+        return std::unique_ptr<BodyReader>{};
+    }
+    if (auto const& can_accept = best_route->getOptions().can_accept) {
+        if (auto rejected = can_accept(request)) {
+            return *rejected;
+        }
+    }
+    return (*best_route)(request, match);
 }
 
 void Dispatcher::addRoute(RouteBase& r) {
     std::lock_guard lock{pimpl->routes_mutex};
     auto& routes = pimpl->routes;
     routes.emplace_back(&r);
+    for (auto const& method : r.getOptions().methods) {
+        auto& indexed = pimpl->routes_by_method[method_index(method)];
+        if (std::find(begin(indexed), end(indexed), &r) == end(indexed)) {
+            indexed.emplace_back(&r);
+        }
+    }
 }
 
 void Dispatcher::removeRoute(RouteBase& r) {
     std::lock_guard lock{pimpl->routes_mutex};
     auto& routes = pimpl->routes;
     routes.erase(std::find(begin(routes), end(routes), &r));
+    for (auto& indexed : pimpl->routes_by_method) {
+        std::erase(indexed, &r);
+    }
 }
 
 void Dispatcher::addRoute(WSRouteBase& r) {
@@ -99,6 +258,18 @@ void Dispatcher::removeRoute(WSRouteBase& r) {
     routes.erase(std::find(begin(routes), end(routes), &r));
 }
 
+void Dispatcher::addRoute(StreamRouteBase& r) {
+    std::lock_guard lock{pimpl->stream_mutex};
+    auto& routes = pimpl->stream_routes;
+    routes.emplace_back(&r);
+}
+
+void Dispatcher::removeRoute(StreamRouteBase& r) {
+    std::lock_guard lock{pimpl->stream_mutex};
+    auto& routes = pimpl->stream_routes;
+    routes.erase(std::find(begin(routes), end(routes), &r));
+}
+
 Dispatcher::ErrorBodyGenerator const& Dispatcher::getErrorBodyGenerator() const {
     return pimpl->error_body_generator;
 }
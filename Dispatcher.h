@@ -3,6 +3,7 @@
 #include "Request.h"
 #include "Response.h"
 #include "Route.h"
+#include "StreamRoute.h"
 #include "Websocket.h"
 #include "WSRoute.h"
 
@@ -16,8 +17,19 @@ struct Dispatcher {
     Dispatcher& operator=(Dispatcher&&) noexcept;
     ~Dispatcher();
 
+    // only routes that take the method of request are considered, HEAD requests go to GET routes (if no route takes HEAD)
+    // and OPTIONS requests are answered with the methods of the routes that match the resource (if no route takes OPTIONS)
     Response route(Request const& request) noexcept;
-    WSRouteBase& routeWS(Request const& request);
+    // for requests whose header has been received but not their body: the Status that route would answer with
+    // if it is clear already (no matching route, a method that is not allowed or a rejection by the can_accept hook of the route)
+    std::optional<Status> canAccept(Request const& request);
+    // the value of an Allow header for the resource of request, empty if no route matches it
+    std::string allowedMethods(Request const& request);
+    // the route that opens a websocket for request, nullptr if there is none
+    WSRouteBase* routeWS(Request const& request);
+    // the reader for the body of request if a stream route takes it, nullptr if it is left to the regular routes
+    // the Status the can_accept hook of the stream route rejected the request with otherwise
+    Expected<std::unique_ptr<BodyReader>> openStream(Request const& request);
 
     void addRoute(RouteBase& r);
     void removeRoute(RouteBase& r);
@@ -25,6 +37,9 @@ struct Dispatcher {
     void addRoute(WSRouteBase& r);
     void removeRoute(WSRouteBase& r);
 
+    void addRoute(StreamRouteBase& r);
+    void removeRoute(StreamRouteBase& r);
+
     ErrorBodyGenerator const& getErrorBodyGenerator() const;
 private:
     struct Pimpl;
@@ -0,0 +1,78 @@
+#include "ETag.h"
+#include "base64.h"
+#include "HeaderFields.h"
+
+#include <array>
+#include <charconv>
+
+#include <openssl/sha.h>
+
+namespace cndl {
+
+namespace {
+
+void append_hex(std::string& out, std::uint64_t value) {
+    std::array<char, 16> buf;
+    auto res = std::to_chars(buf.data(), buf.data() + buf.size(), value, 16);
+    out.append(buf.data(), res.ptr);
+}
+
+std::string_view strip_weak(std::string_view etag) {
+    if (etag.starts_with("W/")) {
+        etag.remove_prefix(2);
+    }
+    return etag;
+}
+
+}
+
+std::string make_etag(std::span<std::byte const> content) {
+    std::array<std::byte, SHA_DIGEST_LENGTH> hash;
+    SHA1(reinterpret_cast<std::uint8_t const*>(content.data()), content.size(), reinterpret_cast<std::uint8_t*>(hash.data()));
+    // half of a sha1 is plenty to tell versions of the same resource apart
+    return "\"" + base64_encode({hash.data(), hash.size() / 2}) + "\"";
+}
+
+std::string make_etag(struct stat const& stat) {
+    std::string etag{"\""};
+    append_hex(etag, stat.st_ino);
+    etag += '-';
+    append_hex(etag, stat.st_size);
+    etag += '-';
+    append_hex(etag, static_cast<std::uint64_t>(stat.st_mtim.tv_sec) * 1'000'000'000 + stat.st_mtim.tv_nsec);
+    etag += '"';
+    return etag;
+}
+
+bool etag_matches(std::string_view if_none_match, std::string_view etag) {
+    etag = strip_weak(etag);
+    while (not if_none_match.empty()) {
+        auto comma = if_none_match.find(',');
+        auto candidate = detail::trim(if_none_match.substr(0, comma));
+        if (candidate == "*" or strip_weak(candidate) == etag) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        if_none_match.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool apply_etag(Request const& request, Response& response, std::string_view etag) {
+    response.fields.erase(Field::etag);
+    response.fields.emplace("ETag", std::string{etag});
+    auto [it, end] = request.header.fields.equal_range(Field::if_none_match);
+    for (; it != end; ++it) {
+        if (etag_matches(it->second, etag)) {
+            response.status_code = 304;
+            response.message_body.reset();
+            response.payloads.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+}
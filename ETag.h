@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Request.h"
+#include "Response.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <sys/stat.h>
+
+namespace cndl {
+
+// a strong entity tag (including the quotes) made from a hash of content
+std::string make_etag(std::span<std::byte const> content);
+// a strong entity tag (including the quotes) made from inode, size and modification time (in ns) of a file
+std::string make_etag(struct stat const& stat);
+
+// whether etag is matched by the value of an If-None-Match header (weak comparison as required by RFC 7232)
+bool etag_matches(std::string_view if_none_match, std::string_view etag);
+
+// sets the ETag of response, if the If-None-Match of request matches it the response is turned into a 304 without body
+// returns true in that case, e.g.:
+//     Response response{body};
+//     apply_etag(request, response, make_etag(body_bytes));
+//     return response;
+bool apply_etag(Request const& request, Response& response, std::string_view etag);
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
+
+namespace cndl {
+
+// a file that was compiled into the binary (see cmake/CndlEmbed.cmake and tools/cndl-embed.cpp)
+// everything is computed when the table is generated, serving an asset takes no syscall besides the send
+struct EmbeddedAsset {
+    struct Variant {
+        std::string_view encoding; // value of Content-Encoding, e.g., "br" or "gzip"
+        std::string_view content;
+        std::string_view etag;
+    };
+
+    std::string_view path;          // relative to the embedded directory, separated by '/'
+    std::string_view content_type;
+    std::string_view etag;
+    std::string_view content;
+    std::span<Variant const> variants; // compressed versions of content, in order of preference
+};
+
+// FNV-1a with a seed and a final avalanche (murmur3's finalizer) so that different seeds give unrelated hashes
+constexpr std::uint32_t embedded_asset_hash(std::string_view str, std::uint32_t seed) {
+    std::uint32_t hash = 2166136261u ^ seed;
+    for (char c : str) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// a generated, read only table of assets with a perfect hash over their paths (hash and displace):
+// the bucket of a path selects the seed that places it in a slot that no other path maps to
+struct EmbeddedAssets {
+    static constexpr std::uint32_t empty_slot = std::numeric_limits<std::uint32_t>::max();
+
+    std::span<EmbeddedAsset const> assets; // sorted by path
+    std::span<std::uint32_t const> seeds;  // one per bucket
+    std::span<std::uint32_t const> slots;  // index into assets (or empty_slot)
+
+    constexpr EmbeddedAsset const* find(std::string_view path) const {
+        if (seeds.empty() or slots.empty()) {
+            return nullptr;
+        }
+        auto seed = seeds[embedded_asset_hash(path, 0) % seeds.size()];
+        auto idx  = slots[embedded_asset_hash(path, seed) % slots.size()];
+        if (idx == empty_slot or assets[idx].path != path) {
+            return nullptr;
+        }
+        return &assets[idx];
+    }
+};
+
+}
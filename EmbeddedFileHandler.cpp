@@ -0,0 +1,82 @@
+#include "EmbeddedFileHandler.h"
+#include "ContentEncoding.h"
+#include "ETag.h"
+
+#include <filesystem>
+
+namespace cndl {
+
+namespace {
+
+StaticBuf as_payload(std::string_view content) {
+    return std::as_bytes(std::span{content.data(), content.size()});
+}
+
+}
+
+EmbeddedFileHandler::EmbeddedFileHandler(EmbeddedAssets const& i_assets)
+    : assets{&i_assets}
+{}
+
+EmbeddedAsset const* EmbeddedFileHandler::find(std::string const& resource) const {
+    if (auto const* asset = assets->find(resource)) {
+        return asset;
+    }
+    // the paths in the table are normalized, only requests like /a/../b or /./a need the (allocating) detour
+    auto normal = std::filesystem::path{resource}.lexically_normal().generic_string();
+    if (normal.starts_with("../") or normal == "..") {
+        return nullptr;
+    }
+    auto first = normal.find_first_not_of('/');
+    if (first == std::string::npos or std::string_view{normal}.substr(first) == resource) {
+        return nullptr;
+    }
+    return assets->find(std::string_view{normal}.substr(first));
+}
+
+OptResponse EmbeddedFileHandler::operator()(Request const& request, std::string const& resource) const {
+    auto const* asset = find(resource);
+    if (not asset) {
+        return std::nullopt;
+    }
+
+    cndl::Response response;
+    response.fields.emplace("cache-control", "max-age=3600, no-cache");
+    response.fields.erase(Field::content_type);
+    response.fields.emplace("Content-Type", std::string{asset->content_type});
+
+    std::string_view content = asset->content;
+    std::string_view etag    = asset->etag;
+    if (not asset->variants.empty()) {
+        response.fields.emplace("Vary", "Accept-Encoding");
+        std::string accept_encoding;
+        auto [it, end] = request.header.fields.equal_range(Field::accept_encoding);
+        for (; it != end; ++it) {
+            accept_encoding += it->second + ",";
+        }
+        for (auto const& variant : asset->variants) {
+            if (accepts_encoding(accept_encoding, variant.encoding)) {
+                response.fields.emplace("Content-Encoding", std::string{variant.encoding});
+                content = variant.content;
+                etag    = variant.etag;
+                break;
+            }
+        }
+    }
+    if (apply_etag(request, response, etag)) {
+        return response;
+    }
+
+    if (request.header.method == "HEAD") {
+        response.fields.emplace("Content-Length", std::to_string(content.size()));
+        return response;
+    }
+    response.payloads.emplace_back(as_payload(content));
+    return response;
+}
+
+bool EmbeddedFileHandler::can_serve_resource(std::string const& resource) const {
+    return find(resource) != nullptr;
+}
+
+}
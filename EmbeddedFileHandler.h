@@ -0,0 +1,24 @@
+#pragma once
+
+#include "EmbeddedAssets.h"
+#include "Route.h"
+
+namespace cndl {
+
+// serves a table of assets that was compiled into the binary, the counterpart of StaticFileHandler without any file system access
+// e.g., with cndl_embed_directory(app web_ui ${CMAKE_CURRENT_SOURCE_DIR}/www) in CMake:
+//     #include "web_ui.h"
+//     cndl::GlobalRoute ui_route{"/ui/(.*)", cndl::EmbeddedFileHandler{web_ui}};
+struct EmbeddedFileHandler {
+    EmbeddedFileHandler(EmbeddedAssets const& assets);
+
+    OptResponse operator()(Request const& request, std::string const& resource) const;
+    bool can_serve_resource(std::string const& resource) const;
+
+private:
+    EmbeddedAsset const* find(std::string const& resource) const;
+
+    EmbeddedAssets const* assets;
+};
+
+}
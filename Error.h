@@ -1,9 +1,19 @@
 #pragma once
 
 #include <stdexcept>
+#include <variant>
 
 namespace cndl {
 
+// an error that is a regular outcome of a request (e.g., a 404 or a 400 for a malformed header)
+// routing and parsing pass it on as a value, unwinding the stack for each of these costs more than serving a request
+// the message has to outlive the Status (i.e., it is a literal)
+struct Status {
+    int code;
+    char const* message{""};
+};
+
+// thrown by (and out of) user code, and by the functions that parse what user code asks for (e.g., body_args)
 struct Error : std::runtime_error {
     Error(int code, char const* message)
     : std::runtime_error(message)
@@ -12,6 +22,8 @@ struct Error : std::runtime_error {
 
     Error(int code) : Error(code, "") {}
 
+    Error(Status status) : Error(status.code, status.message) {}
+
     int code() const {
         return m_code;
     }
@@ -19,4 +31,46 @@ private:
     int m_code;
 };
 
+// either a value or the Status why there is none
+template<typename T>
+struct Expected {
+    Expected(T value) : m_value{std::move(value)} {}
+    Expected(Status status) : m_value{status} {}
+
+    bool has_value() const {
+        return m_value.index() == 0;
+    }
+    explicit operator bool() const {
+        return has_value();
+    }
+
+    T& operator*() {
+        return *std::get_if<0>(&m_value);
+    }
+    T const& operator*() const {
+        return *std::get_if<0>(&m_value);
+    }
+    T* operator->() {
+        return std::get_if<0>(&m_value);
+    }
+    T const* operator->() const {
+        return std::get_if<0>(&m_value);
+    }
+
+    Status error() const {
+        return *std::get_if<1>(&m_value);
+    }
+
+    // the value, throws the Error if there is none
+    T& value() {
+        if (not has_value()) {
+            throw Error{error()};
+        }
+        return **this;
+    }
+
+private:
+    std::variant<T, Status> m_value;
+};
+
 }
@@ -0,0 +1,332 @@
+#include "FileCache.h"
+#include "ContentEncoding.h"
+#include "DateStrHelper.h"
+#include "ETag.h"
+#include "Response.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include <sys/inotify.h>
+
+namespace cndl {
+
+namespace {
+
+// everything that could make a cached fd or its metadata stale
+constexpr std::uint32_t watch_mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+                                   | IN_DELETE | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+using CPath = std::unique_ptr<char, decltype(&::free)>;
+
+// the path with all symlinks, . and .. resolved, a file that does not exist (yet) is resolved up to its directory
+// entries are keyed by it: swapping a symlink or a directory (e.g., in an atomic deploy) leads to another entry
+// instead of one that nobody watches for changes
+std::optional<std::string> resolve(std::string const& path) {
+    if (CPath resolved{::realpath(path.c_str(), nullptr), &::free}; resolved) {
+        return std::string{resolved.get()};
+    }
+    if (errno != ENOENT) {
+        return std::nullopt;
+    }
+    std::filesystem::path fs_path{path};
+    CPath dir{::realpath(fs_path.parent_path().c_str(), nullptr), &::free};
+    if (not dir) {
+        return std::nullopt;
+    }
+    return (std::filesystem::path{dir.get()} / fs_path.filename()).native();
+}
+
+}
+
+FileCache::FileCache(Options const& i_options)
+  : options{i_options}
+  , inotify_fd{::inotify_init1(IN_NONBLOCK|IN_CLOEXEC)}
+{}
+
+FileCache::FileCache(simplyfile::Epoll& i_epoll, Options const& i_options)
+  : FileCache{i_options}
+{
+    if (inotify_fd.valid()) {
+        epoll = &i_epoll;
+        epoll->addFD(inotify_fd, [this](int) {
+            readEvents();
+        }, EPOLLIN, "cndl::FileCache");
+    }
+}
+
+FileCache::~FileCache() {
+    if (epoll) {
+        epoll->rmFD(inotify_fd, true);
+    }
+}
+
+FileCache::EntryPtr FileCache::lookup(std::string const& path) {
+    if (not epoll) {
+        readEvents();
+    }
+    auto resolved = resolve(path);
+    if (not resolved) {
+        ++misses;
+        return nullptr;
+    }
+    {
+        std::lock_guard lock{mutex};
+        if (auto it = entries.find(*resolved); it != entries.end()) {
+            lru.splice(begin(lru), lru, it->second);
+            ++hits;
+            return it->second->entry;
+        }
+    }
+    ++misses;
+
+    std::filesystem::path fs_path{*resolved};
+    auto dir = fs_path.parent_path().native();
+    std::optional<std::uint64_t> generation;
+    if (inotify_fd.valid()) {
+        // the watch has to be in place before the file is opened, otherwise a change in between would go unnoticed
+        std::lock_guard lock{mutex};
+        generation = watch(dir);
+    }
+    auto forget = [&] {
+        if (generation) {
+            std::lock_guard lock{mutex};
+            unwatch(dir);
+        }
+        return nullptr;
+    };
+
+    auto entry = std::make_shared<Entry>();
+    entry->path = *resolved;
+    entry->fd = simplyfile::FileDescriptor{::open(resolved->c_str(), O_RDONLY|O_CLOEXEC)};
+    if (not entry->fd.valid()) {
+        // remember that there is nothing (lookups of precompressed siblings miss most of the time)
+        // creating the file later on is reported through inotify
+        if (generation and errno == ENOENT) {
+            std::lock_guard lock{mutex};
+            insert(*resolved, dir, *generation, nullptr);
+            return nullptr;
+        }
+        return forget();
+    }
+    if (::fstat(entry->fd, &entry->stat) != 0 or not S_ISREG(entry->stat.st_mode)) {
+        return forget();
+    }
+    // files are mostly read from front to back, this makes the kernel read ahead more aggressively
+    ::posix_fadvise(entry->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    entry->content_type  = Response::contentTypeLookup(std::filesystem::path{path}.extension().native());
+    entry->last_modified = mkdatestr(entry->stat.st_mtim);
+    entry->etag          = make_etag(entry->stat);
+    auto size = static_cast<std::size_t>(entry->stat.st_size);
+    if (generation and size <= options.max_cached_file_size and size <= options.max_cached_bytes) {
+        ByteBuf content(size);
+        if (::pread(entry->fd, content.data(), content.size(), 0) == static_cast<ssize_t>(size)) {
+            entry->content = std::make_shared<ByteBuf const>(std::move(content));
+        }
+    }
+
+    // without a watch on its directory we would never learn that the entry went stale
+    if (generation) {
+        std::lock_guard lock{mutex};
+        insert(*resolved, dir, *generation, entry);
+    }
+    return entry;
+}
+
+SharedBuf FileCache::gzipped(EntryPtr const& entry) {
+    auto cached_node = [&]() -> Node* {
+        auto it = entries.find(entry->path);
+        return (it != entries.end() and it->second->entry == entry) ? &*it->second : nullptr;
+    };
+    {
+        std::lock_guard lock{mutex};
+        auto* node = cached_node();
+        if (not node) {
+            // compressing content that is not cached would be repeated on every request
+            return nullptr;
+        }
+        if (node->gzipped) {
+            return node->gzipped;
+        }
+    }
+
+    auto size = static_cast<std::size_t>(entry->stat.st_size);
+    if (size > options.max_compressed_file_size) {
+        return nullptr;
+    }
+    ByteBuf raw;
+    std::span<std::byte const> content;
+    if (entry->content) {
+        content = *entry->content;
+    } else {
+        raw.resize(size);
+        if (::pread(entry->fd, raw.data(), raw.size(), 0) != static_cast<ssize_t>(size)) {
+            return nullptr;
+        }
+        content = raw;
+    }
+    auto compressed = gzip_compress(content);
+    // already compressed formats just get bigger
+    if (not worth_compressing(content.size(), compressed.size())) {
+        return nullptr;
+    }
+
+    std::lock_guard lock{mutex};
+    auto* node = cached_node();
+    if (not node) {
+        return nullptr;
+    }
+    if (not node->gzipped) {
+        node->gzipped = std::make_shared<ByteBuf const>(std::move(compressed));
+        cached_bytes += node->gzipped->size();
+        evict();
+    }
+    return node->gzipped;
+}
+
+FileCache::Stats FileCache::getStats() {
+    std::lock_guard lock{mutex};
+    return Stats{
+        .hits         = hits,
+        .misses       = misses,
+        .evictions    = evictions,
+        .cached_files = lru.size(),
+        .cached_bytes = cached_bytes,
+    };
+}
+
+void FileCache::insert(std::string const& path, std::string const& dir, std::uint64_t generation, EntryPtr entry) {
+    auto watch = watches.find(dir);
+    if (watch == watches.end()) {
+        return;
+    }
+    if (watch->second.generation != generation) {
+        // the directory changed while the file was read, what we have might already be stale
+        unwatch(dir);
+        return;
+    }
+    if (auto it = entries.find(path); it != entries.end()) {
+        // someone else was faster
+        erase(it->second);
+    }
+    lru.emplace_front(Node{path, dir, std::move(entry)});
+    entries.emplace(path, begin(lru));
+    cached_bytes += size(lru.front());
+    ++watch->second.entries;
+    evict();
+}
+
+void FileCache::erase(LRU::iterator it) {
+    cached_bytes -= size(*it);
+    entries.erase(it->path);
+    if (auto watch = watches.find(it->dir); watch != watches.end()) {
+        --watch->second.entries;
+    }
+    auto dir = std::move(it->dir);
+    lru.erase(it);
+    unwatch(dir);
+}
+
+void FileCache::evict() {
+    while (lru.size() > options.max_open_files or cached_bytes > options.max_cached_bytes) {
+        erase(std::prev(end(lru)));
+        ++evictions;
+    }
+}
+
+std::size_t FileCache::size(Node const& node) {
+    std::size_t size = node.gzipped ? node.gzipped->size() : 0;
+    if (node.entry and node.entry->content) {
+        size += node.entry->content->size();
+    }
+    return size;
+}
+
+std::optional<std::uint64_t> FileCache::watch(std::string const& dir) {
+    if (auto it = watches.find(dir); it != watches.end()) {
+        return it->second.generation;
+    }
+    int wd = ::inotify_add_watch(inotify_fd, dir.c_str(), watch_mask);
+    if (wd < 0) {
+        return std::nullopt;
+    }
+    // generations are unique across watches, a lookup cannot mistake a new watch on the same directory for its old one
+    watches.emplace(dir, Watch{wd, ++generations});
+    wd2dir[wd] = dir;
+    return generations;
+}
+
+void FileCache::unwatch(std::string const& dir) {
+    auto it = watches.find(dir);
+    if (it == watches.end() or it->second.entries != 0) {
+        return;
+    }
+    // the IN_IGNORED event this causes refers to an unknown wd and is skipped
+    ::inotify_rm_watch(inotify_fd, it->second.wd);
+    wd2dir.erase(it->second.wd);
+    watches.erase(it);
+}
+
+void FileCache::readEvents() {
+    alignas(inotify_event) std::array<char, 4096> buf;
+    while (true) {
+        auto len = ::read(inotify_fd, buf.data(), buf.size());
+        if (len <= 0) {
+            return;
+        }
+        std::lock_guard lock{mutex};
+        for (char const* p = buf.data(); p < buf.data() + len;) {
+            auto const* event = reinterpret_cast<inotify_event const*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // we lost track of what changed, start over
+                for (auto& [dir, watch] : watches) {
+                    watch.generation = ++generations;
+                }
+                while (not lru.empty()) {
+                    erase(begin(lru));
+                }
+                continue;
+            }
+            auto it = wd2dir.find(event->wd);
+            if (it == wd2dir.end()) {
+                continue;
+            }
+            auto dir = it->second;
+            auto& watch = watches.at(dir);
+            // lookups that are in flight must not insert what they read
+            watch.generation = ++generations;
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // the whole directory is gone
+                if (event->mask & IN_IGNORED) {
+                    // the kernel already dropped the watch, unwatch must not release the wd (it might get reused)
+                    wd2dir.erase(watch.wd);
+                    watch.wd = -1;
+                }
+                for (auto node = begin(lru); node != end(lru);) {
+                    auto next = std::next(node);
+                    if (node->dir == dir) {
+                        erase(node);
+                    }
+                    node = next;
+                }
+                unwatch(dir);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            auto path = (std::filesystem::path{dir} / event->name).native();
+            if (auto entry = entries.find(path); entry != entries.end()) {
+                erase(entry->second);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Payload.h"
+#include "StaticFileHandler.h"
+
+#include <simplyfile/Epoll.h>
+#include <simplyfile/FileDescriptor.h>
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+namespace cndl {
+
+// a bounded cache of open files and their metadata
+// the content of small files is kept in memory as well (within a byte budget)
+// entries are invalidated through inotify whenever the file (or the directory entry pointing to it) changes
+struct FileCache {
+    using Options = StaticFileHandler::Options;
+    using Stats   = StaticFileHandler::CacheStats;
+
+    struct Entry {
+        std::string path; // with symlinks resolved, the key of the entry
+        simplyfile::FileDescriptor fd;
+        struct stat stat;
+        std::string content_type;
+        std::string last_modified;
+        std::string etag;
+        SharedBuf content; // nullptr if the file is too big to be kept in memory
+    };
+    using EntryPtr = std::shared_ptr<Entry const>;
+
+    // inotify events are collected whenever a file is looked up
+    explicit FileCache(Options const& options);
+    // inotify events are collected by the IO loop, looking up a cached file only takes resolving its path
+    FileCache(simplyfile::Epoll& epoll, Options const& options);
+    ~FileCache();
+
+    FileCache(FileCache const&) = delete;
+    FileCache& operator=(FileCache const&) = delete;
+
+    // returns nullptr if path cannot be opened (that is cached as well)
+    // entries are keyed by the path with symlinks resolved, which costs a realpath per lookup
+    EntryPtr lookup(std::string const& path);
+
+    // the gzip compressed content of an entry that lookup returned
+    // compressed on first use and kept as long as the entry is cached
+    // returns nullptr if the file is too big or does not shrink noticeably when compressed
+    SharedBuf gzipped(EntryPtr const& entry);
+
+    Stats getStats();
+
+private:
+    struct Node {
+        std::string path;
+        std::string dir;
+        EntryPtr entry;
+        SharedBuf gzipped{};
+    };
+    using LRU = std::list<Node>;
+
+    struct Watch {
+        int wd;
+        // changes whenever something in the directory changed
+        std::uint64_t generation;
+        // number of cached entries in the directory, the watch is released when it drops to zero
+        std::size_t entries{0};
+    };
+
+    void readEvents();
+    // returns the current generation of dir or nullopt if it cannot be watched
+    std::optional<std::uint64_t> watch(std::string const& dir);
+    void unwatch(std::string const& dir);
+    // drops the entry if the directory changed since generation was taken
+    void insert(std::string const& path, std::string const& dir, std::uint64_t generation, EntryPtr entry);
+    void erase(LRU::iterator it);
+    void evict();
+    static std::size_t size(Node const& node);
+
+    Options options;
+    simplyfile::Epoll* epoll{nullptr};
+    simplyfile::FileDescriptor inotify_fd;
+
+    std::mutex mutex;
+    // most recently used at the front
+    LRU lru;
+    std::unordered_map<std::string, LRU::iterator> entries;
+    std::size_t cached_bytes{0};
+    std::unordered_map<std::string, Watch> watches;
+    std::unordered_map<int, std::string> wd2dir;
+    std::uint64_t generations{0};
+
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> evictions{0};
+};
+
+}
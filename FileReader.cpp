@@ -0,0 +1,70 @@
+#include "FileReader.h"
+#include "BufferPool.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cndl {
+
+FileReader::FileReader(unsigned thread_count) {
+    for (unsigned i{0}; i < thread_count; ++i) {
+        threads.emplace_back([this] {
+            run();
+        });
+    }
+}
+
+FileReader::~FileReader() {
+    {
+        std::lock_guard lock{mutex};
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void FileReader::read(FileRegion region, std::size_t length, Callback cb) {
+    {
+        std::lock_guard lock{mutex};
+        jobs.emplace_back(Job{std::move(region), length, std::move(cb)});
+    }
+    cv.notify_one();
+}
+
+void FileReader::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock{mutex};
+            cv.wait(lock, [this] { return stop or not jobs.empty(); });
+            if (stop) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        // buffers come from the thread local pool of this thread and are released on the IO loop once sent
+        auto data = acquire_buffer(job.length);
+        data.resize(job.length);
+        std::size_t total{0};
+        while (total < data.size()) {
+            auto r = ::pread(job.region.fd, data.data() + total, data.size() - total, job.region.offset + total);
+            if (r <= 0) {
+                break;
+            }
+            total += r;
+        }
+        data.resize(total);
+        if (total < job.region.length) {
+            // the next chunk is likely to be asked for soon, let the kernel start reading it
+            ::posix_fadvise(job.region.fd, job.region.offset + total, std::min(job.length, job.region.length - total), POSIX_FADV_WILLNEED);
+        }
+        job.cb(std::move(data));
+    }
+}
+
+}
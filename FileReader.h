@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Payload.h"
+#include "unique_function.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cndl {
+
+// a pool of threads doing blocking file reads, a cold page cache (or slow storage) must not stall an IO loop
+struct FileReader {
+    // called from one of the pool's threads, data is empty if the read failed
+    using Callback = unique_func<void(ByteBuf data)>;
+
+    explicit FileReader(unsigned threads);
+    // reads that did not start yet are dropped (without calling their callbacks)
+    ~FileReader();
+
+    FileReader(FileReader const&) = delete;
+    FileReader& operator=(FileReader const&) = delete;
+
+    // reads the first length bytes of region (less if the file ends before)
+    void read(FileRegion region, std::size_t length, Callback cb);
+
+private:
+    struct Job {
+        FileRegion region;
+        std::size_t length;
+        Callback cb;
+    };
+
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool stop{false};
+    std::vector<std::thread> threads;
+};
+
+}
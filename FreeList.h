@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace cndl {
+
+// a thread local free list for the memory of objects that are created and destroyed at a high rate (e.g., one per connection)
+// a class opts in with
+//     static void* operator new(std::size_t size) { return FreeList<Class>::allocate(size); }
+//     static void operator delete(void* ptr, std::size_t size) { FreeList<Class>::deallocate(ptr, size); }
+// blocks go to the list of the thread that frees them, beyond max_pooled they are given back to the allocator
+template<typename T, std::size_t max_pooled = 32>
+struct FreeList {
+    static void* allocate(std::size_t size) {
+        auto* list = blocks();
+        if (list and size == sizeof(T) and not list->empty()) {
+            auto* block = list->back();
+            list->pop_back();
+            return block;
+        }
+        return ::operator new(size);
+    }
+
+    static void deallocate(void* block, std::size_t size) {
+        auto* list = blocks();
+        if (list and size == sizeof(T) and list->size() < max_pooled) {
+            list->push_back(block);
+            return;
+        }
+        ::operator delete(block);
+    }
+
+private:
+    struct Blocks {
+        std::vector<void*> list;
+        Blocks() {
+            list.reserve(max_pooled);
+        }
+        ~Blocks() {
+            for (auto* block : list) {
+                ::operator delete(block);
+            }
+            destroyed = true;
+        }
+    };
+    // thread locals are destroyed before statics, whose destructors may still free objects of T
+    static inline thread_local bool destroyed{false};
+
+    // nullptr once the list of this thread is gone
+    static std::vector<void*>* blocks() {
+        if (destroyed) {
+            return nullptr;
+        }
+        thread_local Blocks pooled;
+        return &pooled.list;
+    }
+};
+
+// an allocator on top of FreeList, e.g., for std::allocate_shared (which allocates the object along with its control block)
+template<typename T>
+struct FreeListAllocator {
+    using value_type = T;
+
+    FreeListAllocator() noexcept = default;
+    template<typename U>
+    FreeListAllocator(FreeListAllocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(FreeList<T>::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* ptr, std::size_t n) {
+        FreeList<T>::deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(FreeListAllocator<U> const&) const noexcept {
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,158 @@
+#include "HeaderFields.h"
+
+namespace cndl {
+
+namespace {
+
+std::uint8_t intern(std::string_view name) {
+    auto field = lookup_field(name);
+    return field ? static_cast<std::uint8_t>(*field) : 0xff;
+}
+
+}
+
+HeaderFields::HeaderFields(std::pmr::memory_resource* resource)
+  : entries{resource}
+  , fields{resource}
+{}
+
+void HeaderFields::reserve(std::size_t count) {
+    entries.reserve(count);
+    fields.reserve(count);
+}
+
+HeaderFields::HeaderFields(std::initializer_list<value_type> init) {
+    for (auto const& [name, value] : init) {
+        emplace(name, value);
+    }
+}
+
+std::pair<std::size_t, std::size_t> HeaderFields::range(Field field) const {
+    auto first = slots[static_cast<std::size_t>(field)];
+    if (first == 0) {
+        return {entries.size(), entries.size()};
+    }
+    auto last = std::size_t{first};
+    while (last < fields.size() and fields[last] == static_cast<std::uint8_t>(field)) {
+        ++last;
+    }
+    return {first - 1, last};
+}
+
+std::pair<std::size_t, std::size_t> HeaderFields::range(std::string_view name, std::uint8_t field) const {
+    if (field != no_field) {
+        return range(static_cast<Field>(field));
+    }
+    for (std::size_t first{0}; first < entries.size(); ++first) {
+        if (fields[first] == no_field and detail::ignore_case_equal(entries[first].first, name)) {
+            auto last = first + 1;
+            while (last < entries.size() and fields[last] == no_field and detail::ignore_case_equal(entries[last].first, name)) {
+                ++last;
+            }
+            return {first, last};
+        }
+    }
+    return {entries.size(), entries.size()};
+}
+
+HeaderFields::iterator HeaderFields::emplace(std::string name, std::string value) {
+    auto field = intern(name);
+    auto [first, last] = range(name, field);
+    // a new name goes to the end, another field of a name that is there already right after the others
+    auto pos = first == last ? entries.size() : last;
+    if (pos != entries.size()) {
+        for (auto& slot : slots) {
+            if (slot > pos) {
+                ++slot;
+            }
+        }
+    }
+    if (field != no_field and first == last) {
+        slots[field] = static_cast<std::uint32_t>(pos + 1);
+    }
+    fields.insert(fields.begin() + pos, field);
+    return entries.emplace(entries.begin() + pos, std::move(name), std::move(value));
+}
+
+void HeaderFields::removeRange(std::pair<std::size_t, std::size_t> r) {
+    auto [first, last] = r;
+    if (first == last) {
+        return;
+    }
+    if (fields[first] != no_field) {
+        slots[fields[first]] = 0;
+    }
+    for (auto& slot : slots) {
+        if (slot > last) {
+            slot -= last - first;
+        }
+    }
+    entries.erase(entries.begin() + first, entries.begin() + last);
+    fields.erase(fields.begin() + first, fields.begin() + last);
+}
+
+std::size_t HeaderFields::erase(std::string_view name) {
+    auto r = range(name, intern(name));
+    removeRange(r);
+    return r.second - r.first;
+}
+
+std::size_t HeaderFields::erase(Field field) {
+    auto r = range(field);
+    removeRange(r);
+    return r.second - r.first;
+}
+
+void HeaderFields::clear() {
+    entries.clear();
+    fields.clear();
+    slots = {};
+}
+
+HeaderFields::iterator HeaderFields::find(std::string_view name) {
+    return entries.begin() + range(name, intern(name)).first;
+}
+
+HeaderFields::const_iterator HeaderFields::find(std::string_view name) const {
+    return entries.begin() + range(name, intern(name)).first;
+}
+
+HeaderFields::iterator HeaderFields::find(Field field) {
+    return entries.begin() + range(field).first;
+}
+
+HeaderFields::const_iterator HeaderFields::find(Field field) const {
+    return entries.begin() + range(field).first;
+}
+
+std::pair<HeaderFields::iterator, HeaderFields::iterator> HeaderFields::equal_range(std::string_view name) {
+    auto [first, last] = range(name, intern(name));
+    return {entries.begin() + first, entries.begin() + last};
+}
+
+std::pair<HeaderFields::const_iterator, HeaderFields::const_iterator> HeaderFields::equal_range(std::string_view name) const {
+    auto [first, last] = range(name, intern(name));
+    return {entries.begin() + first, entries.begin() + last};
+}
+
+std::pair<HeaderFields::iterator, HeaderFields::iterator> HeaderFields::equal_range(Field field) {
+    auto [first, last] = range(field);
+    return {entries.begin() + first, entries.begin() + last};
+}
+
+std::pair<HeaderFields::const_iterator, HeaderFields::const_iterator> HeaderFields::equal_range(Field field) const {
+    auto [first, last] = range(field);
+    return {entries.begin() + first, entries.begin() + last};
+}
+
+std::size_t HeaderFields::count(std::string_view name) const {
+    auto [first, last] = range(name, intern(name));
+    return last - first;
+}
+
+std::size_t HeaderFields::count(Field field) const {
+    auto [first, last] = range(field);
+    return last - first;
+}
+
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cndl {
+
+// header fields that are looked up by name often enough to be interned (see lookup_field)
+enum class Field : std::uint8_t {
+    accept,
+    accept_encoding,
+    accept_language,
+    accept_ranges,
+    authorization,
+    cache_control,
+    connection,
+    content_disposition,
+    content_encoding,
+    content_length,
+    content_range,
+    content_type,
+    cookie,
+    date,
+    etag,
+    expect,
+    host,
+    if_match,
+    if_modified_since,
+    if_none_match,
+    if_range,
+    if_unmodified_since,
+    last_modified,
+    location,
+    origin,
+    range,
+    referer,
+    sec_websocket_accept,
+    sec_websocket_key,
+    sec_websocket_protocol,
+    sec_websocket_version,
+    server,
+    set_cookie,
+    transfer_encoding,
+    upgrade,
+    user_agent,
+    vary,
+    x_forwarded_for,
+};
+
+// in the order of Field
+inline constexpr std::array<std::string_view, 38> field_names{
+    "accept", "accept-encoding", "accept-language", "accept-ranges", "authorization", "cache-control", "connection",
+    "content-disposition", "content-encoding", "content-length", "content-range", "content-type", "cookie", "date", "etag",
+    "expect", "host", "if-match", "if-modified-since", "if-none-match", "if-range", "if-unmodified-since", "last-modified",
+    "location", "origin", "range", "referer", "sec-websocket-accept", "sec-websocket-key", "sec-websocket-protocol",
+    "sec-websocket-version", "server", "set-cookie", "transfer-encoding", "upgrade", "user-agent", "vary", "x-forwarded-for",
+};
+
+namespace detail {
+
+constexpr char ascii_lower(char c) {
+    return c >= 'A' and c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr bool ignore_case_equal(std::string_view l, std::string_view r) {
+    if (l.size() != r.size()) {
+        return false;
+    }
+    for (std::size_t i{0}; i < l.size(); ++i) {
+        if (ascii_lower(l[i]) != ascii_lower(r[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// strips optional whitespace (spaces and tabs) from both ends of a field value or one of its list elements
+constexpr std::string_view trim(std::string_view str) {
+    auto first = str.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return str.substr(first, str.find_last_not_of(" \t") - first + 1);
+}
+
+// FNV-1a over the lower case name with a seed and murmur3's finalizer
+constexpr std::uint32_t field_hash(std::string_view name, std::uint32_t seed) {
+    std::uint32_t hash = 2166136261u ^ seed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(ascii_lower(c));
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// a perfect hash over field_names: the first seed for which no two names share a slot (found at compile time)
+struct FieldTable {
+    static constexpr std::size_t size = 256;
+    std::uint32_t seed{0};
+    std::array<std::uint8_t, size> slots{}; // 1 + the index of the name that hashes to the slot, 0 if none
+
+    static constexpr FieldTable make() {
+        for (FieldTable table;; ++table.seed) {
+            table.slots = {};
+            bool collision = false;
+            for (std::size_t i{0}; i < field_names.size() and not collision; ++i) {
+                auto& slot = table.slots[field_hash(field_names[i], table.seed) % size];
+                collision = slot != 0;
+                slot = static_cast<std::uint8_t>(i + 1);
+            }
+            if (not collision) {
+                return table;
+            }
+        }
+    }
+};
+
+inline constexpr FieldTable field_table = FieldTable::make();
+
+}
+
+// the interned name of a header field (case insensitive), nullopt if it is not a well-known one
+constexpr std::optional<Field> lookup_field(std::string_view name) {
+    auto slot = detail::field_table.slots[detail::field_hash(name, detail::field_table.seed) % detail::FieldTable::size];
+    if (slot == 0 or not detail::ignore_case_equal(field_names[slot - 1], name)) {
+        return std::nullopt;
+    }
+    return static_cast<Field>(slot - 1);
+}
+
+constexpr std::string_view field_name(Field field) {
+    return field_names[static_cast<std::size_t>(field)];
+}
+
+// the fields of a request or response header, names are case insensitive
+// stored flat in the order they were added, fields of the same name are kept next to each other
+// well-known fields (see Field) are found through a slot per Field, the others by a scan
+// the flat storage comes from a memory resource (e.g., the arena of a connection), copies use the default one
+struct HeaderFields {
+    using value_type     = std::pair<std::string, std::string>;
+    using iterator       = std::pmr::vector<value_type>::iterator;
+    using const_iterator = std::pmr::vector<value_type>::const_iterator;
+
+    HeaderFields() = default;
+    explicit HeaderFields(std::pmr::memory_resource* resource);
+    HeaderFields(std::initializer_list<value_type> init);
+
+    void reserve(std::size_t count);
+
+    iterator emplace(std::string name, std::string value);
+    // removes all fields of that name, returns how many there were
+    std::size_t erase(std::string_view name);
+    std::size_t erase(Field field);
+    void clear();
+
+    iterator find(std::string_view name);
+    const_iterator find(std::string_view name) const;
+    iterator find(Field field);
+    const_iterator find(Field field) const;
+
+    std::pair<iterator, iterator> equal_range(std::string_view name);
+    std::pair<const_iterator, const_iterator> equal_range(std::string_view name) const;
+    std::pair<iterator, iterator> equal_range(Field field);
+    std::pair<const_iterator, const_iterator> equal_range(Field field) const;
+
+    std::size_t count(std::string_view name) const;
+    std::size_t count(Field field) const;
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    std::size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+private:
+    static constexpr std::uint8_t no_field = 0xff;
+    static constexpr std::size_t field_count = field_names.size();
+
+    // the range of fields named like name (whose interned name is field or no_field)
+    std::pair<std::size_t, std::size_t> range(std::string_view name, std::uint8_t field) const;
+    std::pair<std::size_t, std::size_t> range(Field field) const;
+    void removeRange(std::pair<std::size_t, std::size_t> r);
+
+    std::pmr::vector<value_type> entries;
+    std::pmr::vector<std::uint8_t> fields; // the interned name of every entry (no_field if it has none)
+    std::array<std::uint32_t, field_count> slots{}; // 1 + the index of the first entry of every Field, 0 if there is none
+};
+
+}
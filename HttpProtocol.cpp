@@ -1,6 +1,8 @@
 #include "HttpProtocol.h"
 #include "ConnectionHandler.h"
 #include "Dispatcher.h"
+#include "FreeList.h"
+#include "HeaderFields.h"
 #include "overloaded.h"
 #include "base64.h"
 
@@ -9,6 +11,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <optional>
 
 #include <openssl/sha.h>
 
@@ -19,46 +22,141 @@ using namespace std::string_view_literals;
 namespace {
 
 constexpr auto magic_ws_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"sv;
+constexpr auto continue_response = "HTTP/1.1 100 Continue\r\n\r\n"sv;
+
+// a buffered body is reserved up to this size when its header arrives, beyond that the buffer grows with the data
+// (a claimed Content-Length alone must not pin memory)
+constexpr std::size_t max_body_reserve = 64 * 1024;
+
+// the payloads of a response (if any) are sent as they are, right after the serialized header
+// the response to a HEAD request goes without its body but tells the length it would have
+void write_response(ConnectionHandler& handler, Response&& response, bool head=false) {
+    if (head) {
+        if (response.fields.count(Field::content_length) == 0 and (response.message_body or not response.payloads.empty())) {
+            std::size_t length{response.payloads.empty() ? response.message_body->size() : 0};
+            for (auto const& payload : response.payloads) {
+                length += payload_size(payload);
+            }
+            response.fields.emplace("Content-Length", std::to_string(length));
+        }
+        response.message_body.reset();
+        response.payloads.clear();
+    }
+    handler.write(response.serialize());
+    for (auto& payload : response.payloads) {
+        handler.write(std::move(payload));
+    }
+}
 
 bool starts_with(std::string_view l, std::string_view prefix) {
     return l.size() >= prefix.size() and l.substr(0, prefix.size()) == prefix;
 };
 
-bool ignore_case_cmp(std::string_view l, std::string_view r) {
-    if (l.size() != r.size()) {
-        return false;
+constexpr Status no_boundary{400, "content-type: multipart requires a boundary"};
+constexpr Status bad_upgrade{400, "bad upgrade"};
+
+// the boundary if the body of a request is multipart/*
+Expected<std::optional<std::string>> find_multipart_boundary(Request::Header const& header) {
+    auto enctype = header.fields.find(Field::content_type);
+    if (enctype == header.fields.end()) {
+        return std::optional<std::string>{};
+    }
+    auto split = extractFieldVals(enctype->second);
+    if (split.empty()) {
+        return Status{400, "content-type must be defined"};
+    }
+    if (not std::holds_alternative<std::string>(split[0]) or not starts_with(std::get<std::string>(split[0]), "multipart/"sv)) {
+        return std::optional<std::string>{};
+    }
+    if (split.size() < 2) {
+        return no_boundary;
     }
 
-    return std::equal(begin(l), end(l), begin(r), end(r), [](char l, char r) {
-        return ::tolower(l) == ::tolower(r);
+    auto bd_it = std::find_if(begin(split), end(split), [](auto const& s){
+        return std::visit(detail::overloaded{
+            [](auto const&) { return false; },
+            [](KV_Pair const& pair) { return pair.first=="boundary"; },
+        }, s);
     });
 
+    if (bd_it == std::end(split)) {
+        return no_boundary;
+    }
+    return std::optional<std::string>{std::get<KV_Pair>(*bd_it).second};
+}
+
+bool is_form_urlencoded(Request::Header const& header) {
+    auto enctype = header.fields.find(Field::content_type);
+    if (enctype == header.fields.end()) {
+        return false;
+    }
+    std::string_view type{enctype->second};
+    type = type.substr(0, type.find(';'));
+    type = type.substr(0, type.find_last_not_of(" \t") + 1);
+    return detail::ignore_case_equal(type, "application/x-www-form-urlencoded"sv);
+}
+
+// whether the body is sent in the chunked transfer coding (instead of being delimited by Content-Length)
+// no other transfer coding is supported
+Expected<bool> is_chunked(Request::Header const& header) {
+    auto [it, end] = header.fields.equal_range(Field::transfer_encoding);
+    if (it == end) {
+        return false;
+    }
+    std::string codings;
+    for (; it != end; ++it) {
+        codings += (codings.empty() ? "" : ",") + it->second;
+    }
+    auto split = extractFieldVals(codings, ",");
+    if (split.size() != 1 or not std::holds_alternative<std::string>(split[0]) or not detail::ignore_case_equal(std::get<std::string>(split[0]), "chunked"sv)) {
+        return Status{501, "unsupported transfer-encoding"};
+    }
+    return true;
 }
 
-ProtocolHandler::ProtocolChange connection_upgrade(Request const& request, ConnectionHandler& handler) {
+// whether the client waits for a go-ahead before it sends the body (Expect: 100-continue), other expectations cannot be met
+// HTTP/1.0 clients do not know about it
+Expected<bool> expects_continue(Request::Header const& header) {
+    auto expect = header.fields.find(Field::expect);
+    if (expect == header.fields.end() or header.version == "HTTP/1.0") {
+        return false;
+    }
+    auto split = extractFieldVals(expect->second, ",");
+    if (split.size() != 1 or not std::holds_alternative<std::string>(split[0]) or not detail::ignore_case_equal(std::get<std::string>(split[0]), "100-continue"sv)) {
+        return Status{417};
+    }
+    return true;
+}
+
+Expected<ProtocolHandler::ProtocolChange> connection_upgrade(Request const& request, ConnectionHandler& handler) {
     auto const& header = request.header;
     if (header.method != "GET") {
-        throw Error{405};
+        return Status{405};
     }
 
     auto const& fields = header.fields;
-    auto upgrade_type = fields.find("upgrade");
+    auto upgrade_type = fields.find(Field::upgrade);
     if (upgrade_type == fields.end()) {
-        throw Error{400, "bad upgrade"};
+        return bad_upgrade;
     }
-    if (not ignore_case_cmp(upgrade_type->second, "websocket"sv)) {
-        throw Error{501, "unknown upgrade"};
+    if (not detail::ignore_case_equal(upgrade_type->second, "websocket"sv)) {
+        return Status{501, "unknown upgrade"};
     }
 
-    auto websocket_key      = fields.find("sec-websocket-key");
-    auto websocket_version  = fields.find("sec-websocket-version");
+    auto websocket_key      = fields.find(Field::sec_websocket_key);
+    auto websocket_version  = fields.find(Field::sec_websocket_version);
 
     if (websocket_key == fields.end() or
         websocket_version == fields.end()) {
-        throw Error{400, "bad upgrade"};
+        return bad_upgrade;
     }
     if (websocket_version->second != "13") {
-        throw Error{501, "bad websocket version"};
+        return Status{501, "bad websocket version"};
+    }
+
+    auto* route = handler.getDispatcher().routeWS(request);
+    if (not route) {
+        return Status{404};
     }
 
 
@@ -74,10 +172,9 @@ ProtocolHandler::ProtocolChange connection_upgrade(Request const& request, Conne
 
     auto ws = std::make_unique<Websocket>(&handler);
 
-    auto& route = handler.getDispatcher().routeWS(request);
     handler.write(response.serialize());
-    route.onOpen(request, *ws);
-    ws->setHandler(route.getHandler());
+    route->onOpen(request, *ws);
+    ws->setHandler(route->getHandler());
 
     
     return ProtocolHandler::ProtocolChange{std::move(ws)};
@@ -85,101 +182,269 @@ ProtocolHandler::ProtocolChange connection_upgrade(Request const& request, Conne
 
 }
 
+void* HttpProtocol::operator new(std::size_t size) {
+    return FreeList<HttpProtocol>::allocate(size);
+}
+
+void HttpProtocol::operator delete(void* ptr, std::size_t size) {
+    FreeList<HttpProtocol>::deallocate(ptr, size);
+}
+
+HttpProtocol::~HttpProtocol() {
+    dropRequest();
+}
+
+void HttpProtocol::onPeerClose() {
+    dropRequest();
+}
+
+void HttpProtocol::reclaimMemory() {
+    // the arena holds on to what a big header needed until the next one is parsed
+    if (not request) {
+        arena.release();
+    }
+}
+
+// forgets about the request whose body is being received, a stream route that takes it is told that the body will not arrive
+void HttpProtocol::dropRequest() {
+    if (auto aborted = std::move(reader)) {
+        try {
+            aborted->onAbort();
+        } catch (...) {
+        }
+    }
+    request.reset();
+    multipart_boundary.reset();
+    multipart.reset();
+    chunked.reset();
+    body_remaining = 0;
+    body_size = 0;
+}
+
+// answers the current request with an error, the connection is closed if it is unclear where the next request starts
+void HttpProtocol::reject(Status status, bool request_received, ProtocolChange& protocol_change) {
+    auto& dispatcher = connection_handler->getDispatcher();
+    Response response(status, dispatcher.getErrorBodyGenerator());
+    if (status.code == 405 and request) {
+        if (auto allow = dispatcher.allowedMethods(*request); not allow.empty()) {
+            response.fields.emplace("Allow", std::move(allow));
+        }
+    }
+    dropRequest();
+    if (status.code >= 500 or not request_received) {
+        // e.g., a rejected request whose body might still be sent
+        response.fields.emplace("Connection", "close");
+        protocol_change = nullptr; // this means no further data will be passes to this connection_handler
+    }
+    connection_handler->write(response.serialize());
+}
+
+// hands a piece of the body to whoever processes it: the stream route, the multipart parser or the message body
+void HttpProtocol::deliver(std::string_view piece) {
+    if (reader) {
+        reader->onData({reinterpret_cast<std::byte const*>(piece.data()), piece.size()});
+    } else if (multipart) {
+        multipart->feed(piece);
+    } else {
+        auto const* bytes = reinterpret_cast<std::byte const*>(piece.data());
+        request->message_body.insert(end(request->message_body), bytes, bytes + piece.size());
+    }
+}
+
+// consumes as much of the body as is in received, returns whether the body is complete
+// stops early if the stream route paused (receiving is resumed when it resumes)
+bool HttpProtocol::receiveBody(ByteView& received, int& consumed) {
+    auto const& options = connection_handler->getOptions();
+    auto paused = [this] { return reader and reader->isPaused(); };
+
+    std::string_view data{reinterpret_cast<char const*>(received.data()), received.size()};
+    std::size_t used{0};
+    if (chunked) {
+        while (not chunked->done() and not paused()) {
+            std::size_t n;
+            auto piece = chunked->next(data.substr(used), n);
+            used += n;
+            body_size += piece.size();
+            // the length is unknown up front, the limits are checked while the body is decoded
+            if (body_size > (reader or multipart ? options.max_streamed_body_size : options.max_body_size)) {
+                throw Error(413);
+            }
+            if (not piece.empty()) {
+                deliver(piece);
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+    } else if (body_remaining > 0 and not data.empty() and not paused()) {
+        auto piece = data.substr(0, body_remaining);
+        body_remaining -= piece.size();
+        used = piece.size();
+        deliver(piece);
+    }
+    received = received.substr(used);
+    consumed += used;
+
+    bool complete = chunked ? chunked->done() : body_remaining == 0;
+    if (not complete and paused()) {
+        connection_handler->pauseReceiving();
+    }
+    return complete;
+}
+
 HttpProtocol::ConsumeResult HttpProtocol::onDataReceived(ByteView received) {
     int consumed = 0;
     auto& dispatcher = connection_handler->getDispatcher();
+    auto const& options = connection_handler->getOptions();
     ProtocolHandler::ProtocolChange protocol_change;
 
     // std::cout << std::string_view(reinterpret_cast<char const*>(received.data()), received.size()) << std::endl;
     while (not protocol_change) {
+        // errors before a request was received completely leave us without a clue where the next one starts
+        bool request_received = false;
         try {
-            if (not header) {
+            if (not request) {
                 // test if there is a header in the buffer
                 ByteView crlfcrlf{reinterpret_cast<std::byte const*>("\r\n\r\n"), 4};
                 auto header_end_idx = received.find(crlfcrlf);
-                if (header_end_idx != ByteView::npos) {
-                    header = parse_header(std::string_view{reinterpret_cast<char const*>(received.begin()), header_end_idx+2});
-                    consumed += header_end_idx+4;
-                    received = received.substr(consumed);
+                if ((header_end_idx == ByteView::npos ? received.size() : header_end_idx+4) > options.max_header_size) {
+                    reject(Status{431}, request_received, protocol_change);
+                    continue;
                 }
-            }
-
-            if (header) {
-                if (received.size() < header->content_length) {
-                    return {consumed, ProtocolHandler::ProtocolChange{}}; // content missing
+                if (header_end_idx == ByteView::npos) {
+                    break;
                 }
-
-                Request::MessageBody message{received.begin(), received.begin() + header->content_length};
-                received = received.substr(header->content_length);
-                consumed += header->content_length;
-
-                Request::Header processed_header{std::move(*header)};
-                header.reset();
-
-                auto enctype = processed_header.fields.find("content-type");
-                if (enctype != processed_header.fields.end()) {
-                    auto split = extractFieldVals(enctype->second);
-                    if (split.empty()) {
-                        throw Error(400, "content-type must be defined");
-                    }
-                    if (std::holds_alternative<std::string>(split[0]) and starts_with(std::get<std::string>(split[0]),  "multipart/"sv)) {
-                        if (split.size() < 2) {
-                            throw Error(400, "content-type: multipart requires a boundary");
-                        }
-
-                        auto bd_it = std::find_if(begin(split), end(split), [](auto const& s){
-                            return std::visit(detail::overloaded{
-                                [](auto const&) { return false; },
-                                [](KV_Pair const& pair) { return pair.first=="boundary"; },
-                            }, s);
-                        });
-
-                        if (bd_it == std::end(split)) {
-                            throw Error(400, "content-type: multipart requires a boundary");
-                        }
-
-                        auto boundary = std::get<KV_Pair>(*bd_it).second;
-                        processed_header.body_args = readMultipartBody(
-                            std::string_view{reinterpret_cast<char*>(message.data()),
-                            message.size()}, boundary
-                        );
+                // the previous request is gone, nothing refers to the arena anymore
+                arena.release();
+                auto parsed = try_parse_header(std::string_view{reinterpret_cast<char const*>(received.begin()), header_end_idx+2}, &arena);
+                if (not parsed) {
+                    reject(parsed.error(), request_received, protocol_change);
+                    continue;
+                }
+                request.emplace(Request{std::move(*parsed), {}});
+                auto& header = request->header;
+                consumed += header_end_idx+4;
+                received = received.substr(header_end_idx+4);
+
+                auto boundary = find_multipart_boundary(header);
+                auto is_chunked_body = is_chunked(header);
+                if (not boundary or not is_chunked_body) {
+                    reject(boundary ? is_chunked_body.error() : boundary.error(), request_received, protocol_change);
+                    continue;
+                }
+                multipart_boundary = std::move(*boundary);
+                if (*is_chunked_body) {
+                    chunked = std::make_unique<ChunkedDecoder>();
+                    header.content_length = 0;
+                }
+                body_remaining = header.content_length;
+                body_size = 0;
+
+                // stream routes get the request before its body, everything else is buffered (big multipart bodies are parsed as they arrive)
+                auto stream = dispatcher.openStream(*request);
+                if (not stream) {
+                    reject(stream.error(), request_received, protocol_change);
+                    continue;
+                }
+                reader = std::move(*stream);
+                if (reader) {
+                    reader->on_resume = connection_handler->receiveResumer();
+                } else if (multipart_boundary and (chunked or header.content_length > options.multipart_spool_threshold)) {
+                    multipart = std::make_unique<MultipartParser>(*multipart_boundary, options.multipart_spool_threshold, options.spool_directory);
+                }
+                if (header.content_length > (reader or multipart ? options.max_streamed_body_size : options.max_body_size)) {
+                    reject(Status{413}, request_received, protocol_change);
+                    continue;
+                }
+                if (not reader and not multipart) {
+                    request->message_body.reserve(std::min(header.content_length, max_body_reserve));
+                }
+                // a client that waits before it sends the body is told right away if the request would be rejected anyway
+                // (stream routes have already been asked)
+                auto wants_continue = expects_continue(header);
+                if (not wants_continue) {
+                    reject(wants_continue.error(), request_received, protocol_change);
+                    continue;
+                }
+                if (*wants_continue and (chunked or header.content_length > 0)) {
+                    if (auto rejected = reader ? std::nullopt : dispatcher.canAccept(*request)) {
+                        reject(*rejected, request_received, protocol_change);
+                        continue;
                     }
+                    connection_handler->write(StaticBuf{reinterpret_cast<std::byte const*>(continue_response.data()), continue_response.size()});
                 }
+            }
 
-                auto con_field = processed_header.fields.find("connection");
-                bool con_upgrade = false;
-                if (con_field != processed_header.fields.end()) {
-                    auto split = extractFieldVals(con_field->second, ",;");
-                    con_upgrade = std::find_if(begin(split), end(split), [](auto const& v){
-                        return std::holds_alternative<std::string>(v) and ignore_case_cmp(std::get<std::string>(v), "upgrade"sv);
-                    }) != std::end(split);
+            if (not receiveBody(received, consumed)) {
+                return {consumed, ProtocolHandler::ProtocolChange{}}; // content missing
+            }
+            chunked.reset();
+            bool keep_alive = request->header.version != "HTTP/1.0";
+
+            if (reader) {
+                // the request has to stay alive until the stream route is done with it
+                auto finished = std::move(reader);
+                request_received = true;
+                auto response = finished->onEnd();
+                bool head = request->header.method == "HEAD";
+                request.reset();
+                multipart_boundary.reset();
+                write_response(*connection_handler, response ? std::move(*response) : Response{Status{404}, dispatcher.getErrorBodyGenerator()}, head);
+                if (not keep_alive) {
+                    protocol_change = nullptr; // this means no further data will be passes to this connection_handler
                 }
-                Request request{std::move(processed_header), std::move(message)};
-                // std::cout << request.header.method << " " << request.header.url << std::endl;
-                if (con_upgrade) {
-                    protocol_change = connection_upgrade(std::move(request), *connection_handler);
-                    break;
-                } else {
-                    // dispatch request
-                    auto response = dispatcher.route(std::move(request));
-                    connection_handler->write(response.serialize());
+                continue;
+            }
 
-                    if (processed_header.version=="HTTP/1.0") {
-                        protocol_change = nullptr; // this means no further data will be passes to this connection_handler
-                    }
+            Request current{std::move(*request)};
+            request.reset();
+            if (multipart) {
+                current.header.body_args = multipart->finish();
+                multipart.reset();
+                multipart_boundary.reset();
+            }
+            request_received = true;
+
+            auto con_field = current.header.fields.find(Field::connection);
+            bool con_upgrade = false;
+            if (con_field != current.header.fields.end()) {
+                auto split = extractFieldVals(con_field->second, ",;");
+                con_upgrade = std::find_if(begin(split), end(split), [](auto const& v){
+                    return std::holds_alternative<std::string>(v) and detail::ignore_case_equal(std::get<std::string>(v), "upgrade"sv);
+                }) != std::end(split);
+            }
+            if (multipart_boundary) {
+                // the body is parsed only if a route asks for body_args
+                current.header.body_args = {{std::move(*multipart_boundary), current.message_body}, &readMultipartBody};
+                multipart_boundary.reset();
+            } else if (is_form_urlencoded(current.header)) {
+                current.header.body_args = {{{}, current.message_body}, &readUrlencodedBody};
+            }
+            // std::cout << current.header.method << " " << current.header.url << std::endl;
+            if (con_upgrade) {
+                auto upgraded = connection_upgrade(std::move(current), *connection_handler);
+                if (not upgraded) {
+                    reject(upgraded.error(), request_received, protocol_change);
+                    continue;
                 }
-            } else {
+                protocol_change = std::move(*upgraded);
                 break;
+            } else {
+                // dispatch request
+                write_response(*connection_handler, dispatcher.route(current), current.header.method == "HEAD");
+
+                if (not keep_alive) {
+                    protocol_change = nullptr; // this means no further data will be passes to this connection_handler
+                }
             }
         } catch (Error const& err) {
-            connection_handler->write(Response(err, dispatcher.getErrorBodyGenerator()).serialize());
-            if (err.code() >= 500) {
-                protocol_change = nullptr; // this means no further data will be passes to this connection_handler
-            }
+            reject(Status{err.code(), err.what()}, request_received, protocol_change);
         } catch (std::runtime_error const& err) {
+            dropRequest();
             connection_handler->write(Response(Error{500, err.what()}, dispatcher.getErrorBodyGenerator()).serialize());
             protocol_change = nullptr; // this means no further data will be passes to this connection_handler
         } catch (...) {
+            dropRequest();
             connection_handler->write(Response(Error{500, "uncaught error"}, dispatcher.getErrorBodyGenerator()).serialize());
             protocol_change = nullptr; // this means no further data will be passes to this connection_handler
         }
@@ -1,9 +1,18 @@
 #pragma once
 
+#include "ChunkedDecoder.h"
+#include "MultipartParser.h"
 #include "ProtocolHandler.h"
 #include "Request.h"
+#include "StreamRoute.h"
 
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <string>
+#include <string_view>
 
 namespace cndl {
 
@@ -13,12 +22,37 @@ struct HttpProtocol : ProtocolHandler {
     using ConsumeResult = ProtocolHandler::ConsumeResult;
 
     using ProtocolHandler::ProtocolHandler;
-    virtual ~HttpProtocol() = default;
+    virtual ~HttpProtocol();
 
     ConsumeResult onDataReceived(ByteView received);
+    void onPeerClose() override;
+    void reclaimMemory() override;
+
+    // one is created per connection
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
 
 private:
-    std::optional<Request::Header> header;
+    bool receiveBody(ByteView& received, int& consumed);
+    void deliver(std::string_view piece);
+    void dropRequest();
+    void reject(Status status, bool request_received, ProtocolChange& protocol_change);
+
+    // the storage of the header fields of the current request, it is released (not freed) between requests
+    // so that parsing a header of usual size does not touch the heap for them
+    std::array<std::byte, 2048> arena_buffer;
+    std::pmr::monotonic_buffer_resource arena{arena_buffer.data(), arena_buffer.size()};
+
+    // the request whose body is being received
+    std::optional<Request> request;
+    std::optional<std::string> multipart_boundary;
+    std::unique_ptr<MultipartParser> multipart;
+    // set if a stream route takes the body
+    std::unique_ptr<BodyReader> reader;
+    // the body is either delimited by Content-Length or in the chunked transfer coding
+    std::size_t body_remaining{0};
+    std::unique_ptr<ChunkedDecoder> chunked;
+    std::size_t body_size{0};
 };
 
 
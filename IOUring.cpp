@@ -0,0 +1,196 @@
+#include "IOUring.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cndl {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params& params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void const* arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+[[noreturn]] void throw_errno(char const* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+}
+
+bool IOUring::available() {
+    io_uring_params params{};
+    simplyfile::FileDescriptor fd{io_uring_setup(4, params)};
+    if (not fd.valid()) {
+        return false;
+    }
+    // multishot accept and provided buffer rings arrived in 5.19, multishot recv and zero copy send in 6.0
+    // testing for the latter tells us that everything we need is there
+    constexpr unsigned op_count = 256;
+    alignas(io_uring_probe) std::array<std::byte, sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op)> probe_buf{};
+    auto* probe = reinterpret_cast<io_uring_probe*>(probe_buf.data());
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, op_count) < 0) {
+        return false;
+    }
+    return probe->last_op >= IORING_OP_SEND_ZC and (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+}
+
+IOUring::IOUring(unsigned entries, unsigned i_buffer_count, std::size_t i_buffer_size)
+  : buffer_count{i_buffer_count}
+  , buffer_size{i_buffer_size}
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SUBMIT_ALL;
+    ring_fd = simplyfile::FileDescriptor{io_uring_setup(entries, params)};
+    if (not ring_fd.valid()) {
+        throw_errno("io_uring_setup");
+    }
+    if (not (params.features & IORING_FEAT_SINGLE_MMAP)) {
+        throw std::system_error(ENOSYS, std::generic_category(), "io_uring without IORING_FEAT_SINGLE_MMAP");
+    }
+
+    ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                         params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring_ptr = ::mmap(nullptr, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring_ptr == MAP_FAILED) {
+        ring_ptr = nullptr;
+        throw_errno("mmap io_uring");
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ptr = ::mmap(nullptr, sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) {
+        sqes_ptr = nullptr;
+        throw_errno("mmap io_uring sqes");
+    }
+
+    auto* base = static_cast<std::byte*>(ring_ptr);
+    sq.head      = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sq.tail      = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sq.ring_mask = reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sq.array     = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    sq.sqes      = static_cast<io_uring_sqe*>(sqes_ptr);
+    sq.local_tail = *sq.tail;
+    sq.submitted  = sq.local_tail;
+
+    cq.head      = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cq.tail      = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cq.ring_mask = reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cq.cqes      = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    event_fd = simplyfile::FileDescriptor{::eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)};
+    int efd = event_fd;
+    if (not event_fd.valid() or io_uring_register(ring_fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+        throw_errno("io_uring eventfd");
+    }
+
+    // the provided buffers and the ring they are announced through
+    buf_ring_size = buffer_count * sizeof(io_uring_buf);
+    void* br = ::mmap(nullptr, buf_ring_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (br == MAP_FAILED) {
+        throw_errno("mmap io_uring buffer ring");
+    }
+    buf_ring = static_cast<io_uring_buf_ring*>(br);
+    void* bufs = ::mmap(nullptr, buffer_count * buffer_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED) {
+        throw_errno("mmap io_uring buffers");
+    }
+    buffers = static_cast<std::byte*>(bufs);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr    = reinterpret_cast<std::uint64_t>(buf_ring);
+    reg.ring_entries = buffer_count;
+    reg.bgid         = buffer_group;
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        throw_errno("io_uring register buffer ring");
+    }
+    for (unsigned bid{0}; bid < buffer_count; ++bid) {
+        recycleBuffer(static_cast<std::uint16_t>(bid));
+    }
+}
+
+IOUring::~IOUring() {
+    // closing the ring cancels everything in flight, after that the memory can go away
+    ring_fd.close();
+    if (buffers) {
+        ::munmap(buffers, buffer_count * buffer_size);
+    }
+    if (buf_ring) {
+        ::munmap(buf_ring, buf_ring_size);
+    }
+    if (sqes_ptr) {
+        ::munmap(sqes_ptr, sqes_size);
+    }
+    if (ring_ptr) {
+        ::munmap(ring_ptr, ring_size);
+    }
+}
+
+void IOUring::reserve(unsigned count) {
+    if (sq.local_tail - __atomic_load_n(sq.head, __ATOMIC_ACQUIRE) + count > getEntries()) {
+        submit();
+    }
+}
+
+io_uring_sqe& IOUring::getSQE() {
+    reserve(1);
+    unsigned idx = sq.local_tail & *sq.ring_mask;
+    sq.array[idx] = idx;
+    ++sq.local_tail;
+    auto& sqe = sq.sqes[idx];
+    std::memset(&sqe, 0, sizeof(sqe));
+    return sqe;
+}
+
+void IOUring::submit() {
+    unsigned to_submit = sq.local_tail - sq.submitted;
+    if (to_submit == 0) {
+        return;
+    }
+    __atomic_store_n(sq.tail, sq.local_tail, __ATOMIC_RELEASE);
+    while (to_submit) {
+        int r = io_uring_enter(ring_fd, to_submit, 0, 0);
+        if (r < 0) {
+            if (errno == EINTR or errno == EAGAIN or errno == EBUSY) {
+                continue;
+            }
+            throw_errno("io_uring_enter");
+        }
+        if (r == 0) {
+            break;
+        }
+        to_submit -= r;
+        sq.submitted += r;
+    }
+}
+
+std::span<std::byte const> IOUring::buffer(std::uint16_t bid, std::size_t len) const {
+    return {buffers + bid * buffer_size, std::min(len, buffer_size)};
+}
+
+void IOUring::recycleBuffer(std::uint16_t bid) {
+    auto mask = buffer_count - 1;
+    // not buf_ring->bufs: in C++ the kernel header's flex array declaration places bufs at the wrong offset
+    auto& buf = reinterpret_cast<io_uring_buf*>(buf_ring)[buf_tail & mask];
+    buf.addr = reinterpret_cast<std::uint64_t>(buffers + bid * buffer_size);
+    buf.len  = static_cast<std::uint32_t>(buffer_size);
+    buf.bid  = bid;
+    ++buf_tail;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <simplyfile/FileDescriptor.h>
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace cndl {
+
+// a minimal io_uring (talks to the kernel directly, no liburing needed)
+// including a ring of provided buffers that receives can select from
+struct IOUring {
+    IOUring(unsigned entries, unsigned buffer_count, std::size_t buffer_size);
+    ~IOUring();
+
+    IOUring(IOUring const&) = delete;
+    IOUring& operator=(IOUring const&) = delete;
+
+    // true if the kernel supports everything needed by cndl (multishot accept and recv, provided buffer rings)
+    static bool available();
+
+    // returns a zeroed submission queue entry, submits pending entries if the queue is full
+    io_uring_sqe& getSQE();
+
+    // make sure that the next count calls to getSQE do not submit (needed to keep linked entries together)
+    void reserve(unsigned count);
+
+    // hand all pending submission queue entries to the kernel
+    void submit();
+
+    unsigned getEntries() const {
+        return *sq.ring_mask + 1;
+    }
+
+    // calls f(io_uring_cqe const&) for every available completion
+    template<typename Func>
+    std::size_t reap(Func&& f) {
+        std::size_t count{0};
+        unsigned head = *cq.head;
+        while (head != __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE)) {
+            f(cq.cqes[head & *cq.ring_mask]);
+            ++head;
+            ++count;
+            __atomic_store_n(cq.head, head, __ATOMIC_RELEASE);
+        }
+        return count;
+    }
+
+    // the buffer group id receives have to select from
+    static constexpr std::uint16_t buffer_group = 0;
+    std::span<std::byte const> buffer(std::uint16_t bid, std::size_t len) const;
+    // give a buffer back to the kernel after its content was consumed
+    void recycleBuffer(std::uint16_t bid);
+
+    // signalled by the kernel whenever completions are posted
+    simplyfile::FileDescriptor const& getEventFD() const {
+        return event_fd;
+    }
+
+private:
+    simplyfile::FileDescriptor ring_fd;
+    simplyfile::FileDescriptor event_fd;
+
+    struct {
+        unsigned* head;
+        unsigned* tail;
+        unsigned* ring_mask;
+        unsigned* array;
+        io_uring_sqe* sqes;
+        unsigned local_tail;
+        unsigned submitted;
+    } sq{};
+    struct {
+        unsigned* head;
+        unsigned* tail;
+        unsigned* ring_mask;
+        io_uring_cqe* cqes;
+    } cq{};
+
+    void* ring_ptr{nullptr};
+    std::size_t ring_size{0};
+    void* sqes_ptr{nullptr};
+    std::size_t sqes_size{0};
+
+    io_uring_buf_ring* buf_ring{nullptr};
+    std::size_t buf_ring_size{0};
+    std::byte* buffers{nullptr};
+    unsigned buffer_count;
+    std::size_t buffer_size;
+    std::uint16_t buf_tail{0};
+};
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace cndl {
+
+// a value that is computed from its source on first access and kept from then on
+// e.g., request.header.url_args.find("id") parses the query string only if (and when) a route asks for it
+// not synchronized: the first access must not race with any other access (as is the case for a request in a handler)
+template<typename T, typename Source=std::string>
+struct Lazy {
+    using Parser = T(*)(Source const&);
+
+    Lazy() = default;
+    Lazy(T i_value) : value{std::move(i_value)} {}
+    Lazy(Source i_source, Parser i_parser) : source{std::move(i_source)}, parser{i_parser} {}
+
+    Lazy(Lazy&&) = default;
+    Lazy& operator=(Lazy&&) = default;
+    // the source might refer to something the copy does not own, a copy therefore gets the computed value
+    Lazy(Lazy const& other) : value{other.get()} {}
+    Lazy& operator=(Lazy const& other) {
+        if (this != &other) {
+            *this = Lazy{other.get()};
+        }
+        return *this;
+    }
+    Lazy& operator=(T i_value) {
+        return *this = Lazy{std::move(i_value)};
+    }
+
+    T const& get() const {
+        if (not value) {
+            value.emplace(parser ? parser(source) : T{});
+            source = Source{};
+        }
+        return *value;
+    }
+    T& get() {
+        return const_cast<T&>(std::as_const(*this).get());
+    }
+
+    // whether the value was computed already
+    bool evaluated() const noexcept {
+        return value.has_value();
+    }
+
+    operator T const&() const { return get(); }
+    T const& operator*() const { return get(); }
+    T& operator*() { return get(); }
+    T const* operator->() const { return &get(); }
+    T* operator->() { return &get(); }
+
+    // the lookups of containers, so that code written against T itself (e.g., url_args.count("id")) keeps compiling
+    auto begin() const { return get().begin(); }
+    auto end() const { return get().end(); }
+    auto begin() { return get().begin(); }
+    auto end() { return get().end(); }
+    auto size() const { return get().size(); }
+    bool empty() const { return get().empty(); }
+    template<typename Key>
+    auto find(Key const& key) const { return get().find(key); }
+    template<typename Key>
+    auto find(Key const& key) { return get().find(key); }
+    template<typename Key>
+    auto count(Key const& key) const { return get().count(key); }
+    template<typename Key>
+    auto equal_range(Key const& key) const { return get().equal_range(key); }
+    template<typename Key>
+    auto equal_range(Key const& key) { return get().equal_range(key); }
+
+private:
+    mutable std::optional<T> value;
+    mutable Source source{};
+    Parser parser{nullptr};
+};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace cndl {
+
+// lock-free multi producer single consumer queue
+// producers push from any thread, the consumer takes out everything that was pushed so far in FIFO order
+template<typename T>
+struct MPSCQueue {
+    MPSCQueue() = default;
+    MPSCQueue(MPSCQueue const&) = delete;
+    MPSCQueue& operator=(MPSCQueue const&) = delete;
+
+    ~MPSCQueue() {
+        consume([](T&&) {});
+    }
+
+    // can be called from any thread
+    void push(T value) {
+        auto* node = new Node{std::move(value), head.load(std::memory_order_relaxed)};
+        while (not head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    // must only be called by the consumer
+    // calls f for every element pushed up to now (oldest first) and returns the number of consumed elements
+    template<typename Func>
+    std::size_t consume(Func&& f) {
+        Node* stack = head.exchange(nullptr, std::memory_order_acquire);
+
+        // the nodes are linked newest first, reverse them to restore the push order
+        Node* fifo = nullptr;
+        while (stack) {
+            fifo = std::exchange(stack, std::exchange(stack->next, fifo));
+        }
+
+        std::size_t count{0};
+        while (fifo) {
+            Node* node = std::exchange(fifo, fifo->next);
+            f(std::move(node->value));
+            delete node;
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+    std::atomic<Node*> head{nullptr};
+};
+
+}
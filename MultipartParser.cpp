@@ -0,0 +1,168 @@
+#include "MultipartParser.h"
+#include "Error.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <tuple>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cndl {
+
+namespace {
+
+// part headers are small, anything beyond that is garbage (or an attempt to make us buffer it)
+constexpr std::size_t max_part_header_size = 16 * 1024;
+
+void write_all(int fd, std::string_view data) {
+    while (not data.empty()) {
+        auto w = ::write(fd, data.data(), data.size());
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Error(500, "cannot spool multipart body");
+        }
+        data.remove_prefix(w);
+    }
+}
+
+// an unnamed file that vanishes when it is closed
+// O_TMPFILE is not supported by every file system, a file that is unlinked right away does the same
+simplyfile::FileDescriptor open_spool_file(std::string const& dir) {
+    simplyfile::FileDescriptor fd{::open(dir.c_str(), O_TMPFILE|O_RDWR|O_CLOEXEC, 0600)};
+    if (fd.valid()) {
+        return fd;
+    }
+    auto tmpl = (std::filesystem::path{dir} / "cndl-spool-XXXXXX").native();
+    fd = simplyfile::FileDescriptor{::mkostemp(tmpl.data(), O_CLOEXEC)};
+    if (not fd.valid()) {
+        throw Error(500, "cannot spool multipart body");
+    }
+    ::unlink(tmpl.c_str());
+    return fd;
+}
+
+}
+
+MultipartParser::MultipartParser(std::string_view boundary, std::size_t i_spool_threshold, std::string i_spool_directory)
+  : delimiter{"\r\n--" + std::string{boundary}}
+  , spool_threshold{i_spool_threshold}
+  , spool_directory{i_spool_directory.empty() ? std::filesystem::temp_directory_path().native() : std::move(i_spool_directory)}
+  // the first delimiter does not need to be preceded by a line break, pretending it is makes all delimiters look the same
+  , buffer{"\r\n"}
+{}
+
+void MultipartParser::feed(std::string_view data) {
+    buffer.append(data);
+    while (step()) {}
+}
+
+MultipartParser::BodyArgMap MultipartParser::finish() {
+    if (state != State::epilogue) {
+        throw Error(400, "incomplete multipart body");
+    }
+    return std::move(parts);
+}
+
+// processes what is in buffer, returns false if more data is needed to continue
+bool MultipartParser::step() {
+    using namespace std::string_view_literals;
+
+    switch (state) {
+    case State::preamble: {
+        auto pos = buffer.find(delimiter);
+        if (pos == std::string::npos) {
+            // keep what could be the beginning of the delimiter
+            buffer.erase(0, buffer.size() - std::min(buffer.size(), delimiter.size() - 1));
+            return false;
+        }
+        buffer.erase(0, pos + delimiter.size());
+        state = State::delimiter;
+        return true;
+    }
+    case State::delimiter: {
+        if (buffer.size() < 2) {
+            return false;
+        }
+        if (buffer.starts_with("--"sv)) {
+            buffer.clear();
+            state = State::epilogue;
+            return true;
+        }
+        auto eol = buffer.find("\r\n");
+        if (eol == std::string::npos) {
+            if (buffer.find_first_not_of(" \t") != std::string::npos) {
+                throw Error(400, "missing CRLF after boundary");
+            }
+            return false;
+        }
+        if (std::string_view{buffer}.substr(0, eol).find_first_not_of(" \t") != std::string_view::npos) {
+            throw Error(400, "missing CRLF after boundary");
+        }
+        buffer.erase(0, eol + 2);
+        state = State::part_header;
+        return true;
+    }
+    case State::part_header: {
+        auto header_end = buffer.starts_with("\r\n"sv) ? 0 : buffer.find("\r\n\r\n");
+        if (header_end == std::string::npos) {
+            if (buffer.size() > max_part_header_size) {
+                throw Error(400, "multipart header too big");
+            }
+            return false;
+        }
+        std::tie(part_name, part) = parse_part_header(std::string_view{buffer}.substr(0, header_end + 2));
+        buffer.erase(0, header_end + (header_end == 0 ? 2 : 4));
+        state = State::part_body;
+        return true;
+    }
+    case State::part_body: {
+        auto pos = buffer.find(delimiter);
+        if (pos == std::string::npos) {
+            auto keep = std::min(buffer.size(), delimiter.size() - 1);
+            append(std::string_view{buffer}.substr(0, buffer.size() - keep));
+            buffer.erase(0, buffer.size() - keep);
+            return false;
+        }
+        append(std::string_view{buffer}.substr(0, pos));
+        buffer.erase(0, pos + delimiter.size());
+        if (part.file) {
+            ::lseek(*part.file, 0, SEEK_SET);
+        }
+        parts.emplace(std::move(part_name), std::move(part));
+        part = {};
+        state = State::delimiter;
+        return true;
+    }
+    case State::epilogue:
+        buffer.clear();
+        return false;
+    }
+    return false;
+}
+
+void MultipartParser::append(std::string_view data) {
+    if (part.file) {
+        write_all(*part.file, data);
+        part.file_size += data.size();
+        return;
+    }
+    auto const* bytes = reinterpret_cast<std::byte const*>(data.data());
+    part.content.insert(end(part.content), bytes, bytes + data.size());
+    if (part.content.size() > spool_threshold) {
+        spool();
+    }
+}
+
+void MultipartParser::spool() {
+    auto fd = open_spool_file(spool_directory);
+    write_all(fd, {reinterpret_cast<char const*>(part.content.data()), part.content.size()});
+    part.file_size = part.content.size();
+    part.file = std::make_shared<simplyfile::FileDescriptor const>(std::move(fd));
+    std::vector<std::byte>{}.swap(part.content);
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Request.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace cndl {
+
+// parses a multipart/* body while it is received, big parts are spooled to unnamed temporary files instead of being kept in memory
+struct MultipartParser {
+    using BodyArg    = Request::Header::BodyArg;
+    using BodyArgMap = Request::Header::BodyArgMap;
+
+    // parts bigger than spool_threshold are moved to a file in spool_directory (the system's temp directory if empty)
+    MultipartParser(std::string_view boundary, std::size_t spool_threshold, std::string spool_directory);
+
+    // consumes all of data, throws Error(400) if the body is malformed
+    void feed(std::string_view data);
+    // the parts, to be called after the whole body was fed
+    BodyArgMap finish();
+
+private:
+    enum class State {
+        preamble,    // before the first delimiter
+        delimiter,   // right after a delimiter: either the end of the body or the header of a part follows
+        part_header,
+        part_body,
+        epilogue,    // after the closing delimiter
+    };
+
+    bool step();
+    void append(std::string_view data);
+    void spool();
+
+    std::string delimiter;
+    std::size_t spool_threshold;
+    std::string spool_directory;
+
+    State state{State::preamble};
+    std::string buffer;  // received but not yet processed
+    std::string part_name;
+    BodyArg part;
+    BodyArgMap parts;
+};
+
+}
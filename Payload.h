@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <variant>
+#include <vector>
+
+namespace cndl {
+
+using ByteBuf = std::vector<std::byte>;
+
+// an immutable buffer that can be part of many transmissions at once (e.g., cached file content)
+using SharedBuf = std::shared_ptr<ByteBuf const>;
+
+// memory that outlives every transmission (e.g., assets compiled into the binary), sent without copying or reference counting
+using StaticBuf = std::span<std::byte const>;
+
+// a range of a file that is sent without copying it through user space (sendfile)
+struct FileRegion {
+    int fd{-1};
+    std::uint64_t offset{0};
+    std::size_t length{0};
+    std::shared_ptr<void const> owner{}; // keeps fd open until the region was sent
+};
+
+// anything that can be written to a connection
+using Payload = std::variant<ByteBuf, SharedBuf, StaticBuf, FileRegion>;
+
+inline std::size_t payload_size(Payload const& payload) {
+    if (auto const* region = std::get_if<FileRegion>(&payload)) {
+        return region->length;
+    }
+    if (auto const* shared = std::get_if<SharedBuf>(&payload)) {
+        return *shared ? (*shared)->size() : 0;
+    }
+    if (auto const* buf = std::get_if<StaticBuf>(&payload)) {
+        return buf->size();
+    }
+    return std::get<ByteBuf>(payload).size();
+}
+
+// the bytes of an in memory payload (empty for file regions)
+inline std::span<std::byte const> payload_bytes(Payload const& payload) {
+    if (auto const* shared = std::get_if<SharedBuf>(&payload)) {
+        return *shared ? std::span<std::byte const>{**shared} : std::span<std::byte const>{};
+    }
+    if (auto const* buf = std::get_if<StaticBuf>(&payload)) {
+        return *buf;
+    }
+    if (auto const* buf = std::get_if<ByteBuf>(&payload)) {
+        return *buf;
+    }
+    return {};
+}
+
+}
@@ -24,6 +24,9 @@ struct ProtocolHandler {
     virtual ConsumeResult onDataReceived(ByteView received) = 0;
     // called when the remote hung up
     virtual void onPeerClose() {}
+    // called when the connection has been idle for a while (see ServerOptions::idle_reclaim_after)
+    // buffers that are only kept to be reused by the next message should be given back
+    virtual void reclaimMemory() {}
 
     void setConnectionHandler(ConnectionHandler* new_handler) {
         connection_handler = new_handler;
@@ -3,40 +3,130 @@
 #include "overloaded.h"
 
 #include <algorithm>
+#include <bit>
 #include <charconv>
+#include <optional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace cndl {
 
-std::string url_unescape(std::string_view str) {
-    std::string unescaped;
+namespace {
+
+// the position of the first character that has to be decoded ('%', and '+' if plus_is_space), npos if there is none
+// most URLs and arguments contain none, so this scan is all that is done for them
+std::size_t find_escape(std::string_view str, bool plus_is_space) {
+    std::size_t i{0};
+#ifdef __SSE2__
+    auto const percent = _mm_set1_epi8('%');
+    auto const plus    = _mm_set1_epi8(plus_is_space ? '+' : '%');
+    for (; i + 16 <= str.size(); i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(str.data() + i));
+        auto hits  = _mm_or_si128(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus));
+        if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits))) {
+            return i + std::countr_zero(mask);
+        }
+    }
+#endif
+    for (; i < str.size(); ++i) {
+        if (str[i] == '%' or (plus_is_space and str[i] == '+')) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+int hex_value(char c) {
+    if (c >= '0' and c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' and c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+constexpr Status bad_escaping{400, "Bad URL escaping"};
+constexpr Status bad_request_line{400, "invalid Request-Line"};
+
+// url_unescape without throwing, nullopt if str is not escaped properly
+std::optional<std::string_view> try_unescape(std::string_view str, std::string& buffer, bool plus_is_space) {
+    auto pos = find_escape(str, plus_is_space);
+    if (pos == std::string_view::npos) {
+        return str;
+    }
+    buffer.clear();
+    buffer.reserve(str.size());
     std::size_t start{0};
-    while (true) {
-        auto pos = str.find('%', start);
-        unescaped += str.substr(start, pos-start);
-        if (pos == std::string_view::npos) {
-            break;
+    while (pos != std::string_view::npos) {
+        buffer += str.substr(start, pos-start);
+        if (str[pos] == '+') {
+            buffer += ' ';
+            start = pos+1;
+        } else {
+            if (pos+2 >= str.size()) {
+                return std::nullopt;
+            }
+            auto high = hex_value(str[pos+1]);
+            auto low  = hex_value(str[pos+2]);
+            if (high < 0 or low < 0) {
+                return std::nullopt;
+            }
+            buffer += static_cast<char>(high * 16 + low);
+            start = pos+3;
         }
-        if (pos > str.size()-2) {
-            throw Error(400, "Bad URL escaping");
+        auto next = find_escape(str.substr(start), plus_is_space);
+        pos = next == std::string_view::npos ? next : start + next;
+    }
+    buffer += str.substr(start);
+    return buffer;
+}
+
+}
+
+std::string_view url_unescape(std::string_view str, std::string& buffer, bool plus_is_space) {
+    if (auto unescaped = try_unescape(str, buffer, plus_is_space)) {
+        return *unescaped;
+    }
+    throw Error(bad_escaping);
+}
+
+namespace {
+
+// calls f(key, value) for every argument of a query string (or an application/x-www-form-urlencoded body)
+// keys and values are decoded exactly once ('+' is a space there) and are only valid during the call
+template<typename F>
+void for_each_url_arg(std::string_view query, F&& f) {
+    std::string key_buffer;
+    std::string value_buffer;
+    while (not query.empty()) {
+        auto arg = query.substr(0, query.find('&'));
+        query.remove_prefix(std::min(arg.size()+1, query.size()));
+        if (arg.empty()) {
+            continue;
         }
-        int val{};
-        auto res =std::from_chars(&str[pos+1], &str[pos+3], val, 16);
-        if (res.ec == std::errc::invalid_argument) {
-            throw Error(400, "Bad URL escaping");
+        auto eq_sign = arg.find('=');
+        auto key = url_unescape(arg.substr(0, eq_sign), key_buffer, true);
+        if (eq_sign == std::string_view::npos) {
+            f(key, std::string_view{});
+        } else {
+            f(key, url_unescape(arg.substr(eq_sign+1), value_buffer, true));
         }
-        unescaped += char(val);
-        start = pos+3;
     }
-    return unescaped;
 }
 
-std::string to_lower(std::string str) {
-    std::transform(begin(str), end(str), begin(str), ::tolower);
-    return str;
 }
 
-std::string to_lower(std::string_view str) {
-    return to_lower(std::string{str});
+std::string url_unescape(std::string_view str) {
+    std::string buffer;
+    auto unescaped = url_unescape(str, buffer);
+    if (unescaped.data() == buffer.data()) {
+        return buffer;
+    }
+    return std::string{unescaped};
 }
 
 std::vector<FieldVal> extractFieldVals(std::string_view str, std::string_view delimiters) {
@@ -54,6 +144,7 @@ std::vector<FieldVal> extractFieldVals(std::string_view str, std::string_view de
     };
 
     std::vector<FieldVal> fields;
+    std::string buffer;
 
     auto start {0U};
     auto spaces = " \t";
@@ -70,9 +161,10 @@ std::vector<FieldVal> extractFieldVals(std::string_view str, std::string_view de
         }
         auto eq_sign = chunk.find('=');
         if (eq_sign != std::string_view::npos) {
-            fields.emplace_back(std::make_pair(url_unescape(remove_quots(chunk.substr(0, eq_sign))), url_unescape(remove_quots(chunk.substr(eq_sign+1)))));
+            std::string key{url_unescape(remove_quots(chunk.substr(0, eq_sign)), buffer)};
+            fields.emplace_back(std::make_pair(std::move(key), std::string{url_unescape(remove_quots(chunk.substr(eq_sign+1)), buffer)}));
         } else {
-            fields.emplace_back(url_unescape(std::string{remove_quots(chunk)}));
+            fields.emplace_back(std::string{url_unescape(remove_quots(chunk), buffer)});
         }
 
         if (end == std::string::npos) {
@@ -84,8 +176,22 @@ std::vector<FieldVal> extractFieldVals(std::string_view str, std::string_view de
     return fields;
 }
 
-Request::Header::FieldMap parse_fields(std::string_view fields) {
-    Request::Header::FieldMap fields_map;
+HeaderFields parse_fields(std::string_view fields) {
+    HeaderFields fields_map;
+    if (auto failure = parse_fields(fields, fields_map)) {
+        throw Error(*failure);
+    }
+    return fields_map;
+}
+
+std::optional<Status> parse_fields(std::string_view fields, HeaderFields& fields_map) {
+    // one line per field, the storage is allocated once
+    std::size_t lines{0};
+    for (auto eol = fields.find("\r\n"); eol != std::string_view::npos; eol = fields.find("\r\n", eol+2)) {
+        ++lines;
+    }
+    fields_map.reserve(fields_map.size() + lines);
+
     std::string_view illegal_chars{" \t\r\n"};
     auto pos = 0U;
     while (pos < fields.size()) {
@@ -96,105 +202,157 @@ Request::Header::FieldMap parse_fields(std::string_view fields) {
         std::string_view line = fields.substr(pos, eol-pos);
         auto colon_idx = line.find(':');
         if (colon_idx == std::string_view::npos || colon_idx == 0) {
-            throw Error(400, "invalid header field");
+            return Status{400, "invalid header field"};
         }
 
-        std::string field_name = to_lower(line.substr(0, colon_idx));
+        // names are kept as they were sent, HeaderFields compares them case insensitively
+        auto field_name = line.substr(0, colon_idx);
         if (field_name.find_first_of(illegal_chars) != std::string_view::npos) {
-            throw Error(400, "invalid Request-Line");
+            return bad_request_line;
         }
 
         auto field_val_beg = line.find_first_not_of(illegal_chars, colon_idx+1);
         if (field_val_beg == std::string_view::npos) {
-            throw Error(400, "invalid Request-Line");
+            return bad_request_line;
         }
         auto field_val_end = line.find_last_not_of(illegal_chars);
         if (field_val_end == std::string_view::npos || field_val_beg>field_val_end) {
-            throw Error(400, "invalid Request-Line");
+            return bad_request_line;
         }
-        std::string field_value{line.substr(field_val_beg, field_val_end-field_val_beg+1)};
-
-        fields_map.emplace(url_unescape(field_name), url_unescape(std::move(field_value)));
+        // field values are not URL encoded, those that carry encoded parts (e.g., cookies) are decoded when they are parsed
+        fields_map.emplace(std::string{field_name}, std::string{line.substr(field_val_beg, field_val_end-field_val_beg+1)});
         pos = eol+2;
     }
-    return fields_map;
+    return std::nullopt;
+}
+
+Request::Header::FieldMap parse_url_args(std::string const& query) {
+    Request::Header::FieldMap url_args;
+    for_each_url_arg(query, [&](std::string_view key, std::string_view value) {
+        url_args.emplace(key, value);
+    });
+    return url_args;
+}
+
+Request::Header::CookieMap parse_cookies(std::string const& cookie_fields) {
+    Request::Header::CookieMap cookies;
+    for (auto const& c : extractFieldVals(cookie_fields)) {
+        if (auto kvp = std::get_if<KV_Pair>(&c); kvp) {
+            cookies.insert_or_assign(kvp->first, kvp->second);
+        }
+    }
+    return cookies;
 }
 
-Request::Header parse_header(std::string_view request) {
+Request::Header parse_header(std::string_view request, std::pmr::memory_resource* resource) {
+    return std::move(try_parse_header(request, resource).value());
+}
+
+Expected<Request::Header> try_parse_header(std::string_view request, std::pmr::memory_resource* resource) {
     using namespace std::string_view_literals;
 
-    Request::Header header;
+    Request::Header header{resource};
 
     auto first_line_end = request.find("\r\n"sv);
     if (first_line_end == std::string_view::npos) {
-        throw Error(400, "invalid Request-Line");
+        return bad_request_line;
     }
 
     auto method_end = request.find(' ');
     if (method_end == std::string_view::npos) {
-        throw Error(400, "invalid Request-Line");
+        return bad_request_line;
     }
 
     auto URL_end = request.find(' ', method_end+1);
     if (URL_end == std::string_view::npos) {
-        throw Error(400, "invalid Request-Line");
+        return bad_request_line;
     }
 
     auto raw_url = std::string_view{request.data()+method_end+1, URL_end-method_end-1};
 
     header.method = request.substr(0, method_end);
-    header.url = url_unescape(raw_url);
-    header.resource = header.url.substr(0, header.url.find('?'));
+    std::string buffer;
+    auto url = try_unescape(raw_url, buffer, false);
+    if (not url) {
+        return bad_escaping;
+    }
+    header.url = *url;
+    // the path is decoded on its own so that an escaped '?' does not end it
+    auto path = try_unescape(raw_url.substr(0, raw_url.find('?')), buffer, false);
+    if (not path) {
+        return bad_escaping;
+    }
+    header.resource = *path;
     header.version = request.substr(URL_end+1, first_line_end-URL_end-1);
 
     auto trailer_idx = raw_url.find('?');
     if (trailer_idx != std::string_view::npos and trailer_idx + 1 < raw_url.size()) {
         std::string_view args_part = raw_url.substr(trailer_idx+1); // drop the '?'
         args_part = args_part.substr(0, args_part.find('#'));
-
-        auto fields = extractFieldVals(args_part, "&"sv);
-        for (auto const& f: fields) {
-            std::visit(detail::overloaded{
-                [&](KV_Pair const& pair) {
-                    header.url_args.emplace(
-                        url_unescape(pair.first),
-                        url_unescape(pair.second));
-                },
-                [&](std::string const& str) {
-                    header.url_args.emplace(
-                        url_unescape(str),
-                        "");
-                }
-            }, f);
-        }
+        header.url_args = {std::string{args_part}, &parse_url_args};
     }
 
-    header.fields = parse_fields(request.substr(first_line_end+2));
+    if (auto failure = parse_fields(request.substr(first_line_end+2), header.fields)) {
+        return *failure;
+    }
 
-    auto cl_it = header.fields.find("content-length");
-    if (cl_it != header.fields.end()) {
-        std::string_view sv{cl_it->second};
-        auto res =std::from_chars(sv.begin(), sv.end(), header.content_length);
-        if (res.ec == std::errc::invalid_argument) {
-            throw Error(400, "invalid content-length");
+    // a length we cannot trust leaves us without a clue where the body ends (and the next request starts)
+    auto [cl_first, cl_last] = header.fields.equal_range(Field::content_length);
+    for (auto it = cl_first; it != cl_last; ++it) {
+        std::string_view sv{it->second};
+        std::size_t length{};
+        auto res = std::from_chars(sv.data(), sv.data() + sv.size(), length);
+        if (res.ec != std::errc{} or res.ptr != sv.data() + sv.size()) {
+            return Status{400, "invalid content-length"};
+        }
+        if (it != cl_first and length != header.content_length) {
+            return Status{400, "conflicting content-length"};
         }
+        header.content_length = length;
     }
 
-    auto cookies = header.fields.equal_range("cookie");
-    while (cookies.first != cookies.second) {
-        auto extracted = extractFieldVals(cookies.first->second);
-        for (auto const& c : extracted) {
-            if (auto kvp = std::get_if<KV_Pair>(&c); kvp) {
-                header.cookies.insert_or_assign(kvp->first, kvp->second);
-            }
+    auto cookies = header.fields.equal_range(Field::cookie);
+    if (cookies.first != cookies.second) {
+        std::string cookie_fields = cookies.first->second;
+        while (++cookies.first != cookies.second) {
+            cookie_fields += ";" + cookies.first->second;
         }
-        ++cookies.first;
+        header.cookies = {std::move(cookie_fields), &parse_cookies};
     }
 
     return header;
 }
 
 
+std::pair<std::string, Request::Header::BodyArg> parse_part_header(std::string_view part_header) {
+    auto fields = parse_fields(part_header);
+
+    auto cd_it = fields.find(Field::content_disposition);
+    if (cd_it == fields.end()) {
+        throw Error(400, "missing content-disposition header in multipart body");
+    }
+
+    auto cd_split = extractFieldVals(cd_it->second);
+    auto name_it = std::find_if(begin(cd_split), end(cd_split), [](FieldVal const& fv){
+        return std::holds_alternative<KV_Pair>(fv) and std::get<KV_Pair>(fv).first == "name";
+    });
+    if (name_it == cd_split.end()) {
+        throw Error(400, "missing name field in content-disposition");
+    }
+
+    Request::Header::BodyArg ba;
+    for (auto const& s : cd_split) {
+        std::visit(detail::overloaded{
+            [&](std::string const& s) {ba.fields.emplace(s, "");},
+            [&](KV_Pair const& kv) {ba.fields.emplace(kv.first, kv.second);}
+        }, s);
+    }
+    for (auto const& [k, v] : fields) {
+        ba.fields.emplace(k, v);
+    }
+    return {std::get<KV_Pair>(*name_it).second, std::move(ba)};
+}
+
 Request::Header::BodyArgMap readMultipartBody(std::string_view body, std::string_view boundary) {
     using namespace std::string_view_literals;
     Request::Header::BodyArgMap body_args;
@@ -223,38 +381,33 @@ Request::Header::BodyArgMap readMultipartBody(std::string_view body, std::string
         if (header_end == std::string_view::npos) {
             throw Error(400, "missing header information in multipart body");
         }
-        auto fields = parse_fields(content.substr(0, header_end+2));
-
-        auto cd_it = fields.find("content-disposition");
-        if (cd_it == fields.end()) {
-            throw Error(400, "missing content-disposition header in multipart body");
-        }
-
-        auto cd_split = extractFieldVals(cd_it->second);
-        auto name_it = std::find_if(begin(cd_split), end(cd_split), [](FieldVal const& fv){
-            return std::holds_alternative<KV_Pair>(fv) and std::get<KV_Pair>(fv).first == "name";
-        });
-        if (name_it == cd_split.end()) {
-            throw Error(400, "missing name field in content-disposition");
-        }
-
-        Request::Header::BodyArg ba;
-        for (auto const& s : cd_split) {
-            std::visit(detail::overloaded{
-                [&](std::string const& s) {ba.fields.emplace(s, "");},
-                [&](KV_Pair const& kv) {ba.fields.emplace(kv.first, kv.second);}
-            }, s);
-        }
-        for (auto const& [k, v] : fields) {
-            ba.fields.emplace(k, v);
-        }
-
+        auto [name, ba] = parse_part_header(content.substr(0, header_end+2));
         auto body_content = content.substr(header_end+4);
-        std::transform(begin(body_content), end(body_content), std::back_inserter(ba.content), [](char c) { return std::byte(c); });
-        body_args.emplace(std::get<KV_Pair>(*name_it).second, std::move(ba));
+        auto const* data = reinterpret_cast<std::byte const*>(body_content.data());
+        ba.content.assign(data, data + body_content.size());
+        body_args.emplace(std::move(name), std::move(ba));
         start = body.find(boundary, start);
     }
     return body_args;
 }
 
+Request::Header::BodyArgMap readMultipartBody(Request::Header::EncodedBody const& body) {
+    return readMultipartBody(std::string_view{reinterpret_cast<char const*>(body.content.data()), body.content.size()}, body.boundary);
+}
+
+Request::Header::BodyArgMap readUrlencodedBody(std::string_view body) {
+    Request::Header::BodyArgMap body_args;
+    for_each_url_arg(body, [&](std::string_view key, std::string_view value) {
+        Request::Header::BodyArg arg;
+        auto const* bytes = reinterpret_cast<std::byte const*>(value.data());
+        arg.content.assign(bytes, bytes + value.size());
+        body_args.emplace(key, std::move(arg));
+    });
+    return body_args;
+}
+
+Request::Header::BodyArgMap readUrlencodedBody(Request::Header::EncodedBody const& body) {
+    return readUrlencodedBody(std::string_view{reinterpret_cast<char const*>(body.content.data()), body.content.size()});
+}
+
 }
@@ -1,8 +1,19 @@
 #pragma once
 
+#include "Error.h"
+#include "HeaderFields.h"
+#include "Lazy.h"
+
+#include <simplyfile/FileDescriptor.h>
 #include <simplyfile/socket/Socket.h>
 
+#include <cstddef>
+#include <map>
+#include <memory_resource>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <variant>
@@ -13,22 +24,41 @@ struct Request {
     struct Header {
         using FieldMap = std::unordered_multimap<std::string, std::string>;
 
+        Header() = default;
+        // the storage of fields comes from resource
+        explicit Header(std::pmr::memory_resource* resource) : fields{resource} {}
+
         struct BodyArg {
-            FieldMap fields;
+            HeaderFields fields;
             std::vector<std::byte> content;
+            // parts of big (streamed) multipart bodies that exceed ServerOptions::multipart_spool_threshold are not held in content
+            // but in an unnamed temporary file (positioned at its start) which is gone once the last reference to it is
+            std::shared_ptr<simplyfile::FileDescriptor const> file;
+            std::size_t file_size{0};
         };
         using BodyArgMap = std::unordered_multimap<std::string, BodyArg>;
+        using CookieMap  = std::map<std::string, std::string>;
+
+        // what body_args are parsed from: the message body of the request the header belongs to
+        // and its boundary if it is multipart/* (empty if it is application/x-www-form-urlencoded)
+        struct EncodedBody {
+            std::string boundary;
+            std::span<std::byte const> content;
+        };
 
         std::string method;
         std::string resource;    // the path for the resource (excl. parameters)
         std::string url;         // the requested URL (incl. parameters)
         std::string version;
 
-        std::map<std::string, std::string> cookies;
-        FieldMap fields;
-        FieldMap url_args;
+        // cookies, url_args and body_args are parsed on first access (only the routes that need them pay for them)
+        Lazy<CookieMap> cookies;
+        HeaderFields fields;
+        Lazy<FieldMap> url_args;
 
-        BodyArgMap body_args;    // arguments that were passed via multipart/*
+        // arguments that were passed via multipart/* or application/x-www-form-urlencoded (those have no fields, only content)
+        // refers to the message body, the header must not be separated from its request before they were accessed
+        Lazy<BodyArgMap, EncodedBody> body_args;
 
         std::size_t content_length{0};
     };
@@ -43,9 +73,24 @@ using FieldVal  = std::variant<std::string, KV_Pair>;
 
 std::vector<FieldVal> extractFieldVals(std::string_view str, std::string_view delimiter=";,");
 
+// decodes %XX escapes (and '+' to a space if plus_is_space, as in query strings)
+// returns str itself if there is nothing to decode, otherwise the decoded string which is stored in buffer
+std::string_view url_unescape(std::string_view str, std::string& buffer, bool plus_is_space=false);
 std::string url_unescape(std::string_view str);
-Request::Header::FieldMap parse_fields(std::string_view fields);
+HeaderFields parse_fields(std::string_view fields);
+// returns the Status to answer with if fields are malformed
+std::optional<Status> parse_fields(std::string_view fields, HeaderFields& out);
+Request::Header::FieldMap parse_url_args(std::string const& query);
+Request::Header::CookieMap parse_cookies(std::string const& cookie_fields);
+// the name and the fields of a part of a multipart body from the header of that part
+std::pair<std::string, Request::Header::BodyArg> parse_part_header(std::string_view part_header);
 Request::Header::BodyArgMap readMultipartBody(std::string_view body, std::string_view boundary);
-Request::Header parse_header(std::string_view request);
+Request::Header::BodyArgMap readMultipartBody(Request::Header::EncodedBody const& body);
+Request::Header::BodyArgMap readUrlencodedBody(std::string_view body);
+Request::Header::BodyArgMap readUrlencodedBody(Request::Header::EncodedBody const& body);
+// the storage of the header fields is taken from resource
+Request::Header parse_header(std::string_view request, std::pmr::memory_resource* resource=std::pmr::get_default_resource());
+// as parse_header but a malformed header results in a Status instead of an Error being thrown
+Expected<Request::Header> try_parse_header(std::string_view request, std::pmr::memory_resource* resource=std::pmr::get_default_resource());
 
 }
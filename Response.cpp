@@ -1,9 +1,13 @@
 #include "Response.h"
+#include "BufferPool.h"
 #include "DateStrHelper.h"
 
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <map>
 #include <string_view>
+#include <unordered_map>
 
 namespace cndl {
 
@@ -12,81 +16,84 @@ using namespace std::string_view_literals;
 
 namespace {
 
-const std::unordered_map<int, std::string_view> code2reason {
+// indexed by the status code
+constexpr auto code2reason = [] {
+    std::array<std::string_view, 600> table{};
     // 1xx switching protocols
-    {101, "Switching Protocols"},
+    table[101] = "Switching Protocols";
 
     // 2xx success
-    {200, "OK"},
-    {201, "Created"},
-    {202, "Accepted"},
-    {203, "Non-Authoritative Information"},
-    {204, "No Content"},
-    {205, "Reset Content"},
-    {206, "Partial Content"},
-    {207, "Multi-Status"},
-    {208, "Already Reported"},
-    {226, "IM Used"},
+    table[200] = "OK";
+    table[201] = "Created";
+    table[202] = "Accepted";
+    table[203] = "Non-Authoritative Information";
+    table[204] = "No Content";
+    table[205] = "Reset Content";
+    table[206] = "Partial Content";
+    table[207] = "Multi-Status";
+    table[208] = "Already Reported";
+    table[226] = "IM Used";
 
     // 3xx redirection
-    {300, "Multiple Choices"},
-    {301, "Moved Permanently"},
-    {302, "Found"},
-    {303, "See Other"},
-    {304, "Not Modified"},
-    {305, "Use Proxy"},
-    {306, "Switch Proxy"},
-    {307, "Temporary Redirect"},
-    {308, "Permanent Redirect"},
+    table[300] = "Multiple Choices";
+    table[301] = "Moved Permanently";
+    table[302] = "Found";
+    table[303] = "See Other";
+    table[304] = "Not Modified";
+    table[305] = "Use Proxy";
+    table[306] = "Switch Proxy";
+    table[307] = "Temporary Redirect";
+    table[308] = "Permanent Redirect";
 
     // 4xx client errors
-    {400, "Bad Request"},
-    {401, "Unauthorized"},
-    {402, "Payment Required"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-    {405, "Method Not Allowed"},
-    {406, "Not Acceptable"},
-    {407, "Proxy Authentication Required"},
-    {408, "Request Timeout"},
-    {409, "Conflict"},
-
-    {410, "Gone"},
-    {411, "Length Required"},
-    {412, "Precondition Failed"},
-    {413, "Payload Too Large"},
-    {414, "URI Too Long"},
-    {415, "Unsupported Media Type"},
-    {416, "Range Not Satisfiable"},
-    {417, "Expectation Failed"},
-    {418, "I'm a teapot"},
-
-    {421, "Misdirected Request"},
-    {422, "Unprocessable Entity"},
-    {423, "Locked"},
-    {424, "Failed Dependency"},
-    {425, "Too Early"},
-    {426, "Upgrade Required"},
-    {428, "Precondition Required"},
-    {429, "Too Many Requests"},
-
-    {431, "Request Header Fields Too Large"},
-    {451, "Unavailable For Legal Reasons"},
+    table[400] = "Bad Request";
+    table[401] = "Unauthorized";
+    table[402] = "Payment Required";
+    table[403] = "Forbidden";
+    table[404] = "Not Found";
+    table[405] = "Method Not Allowed";
+    table[406] = "Not Acceptable";
+    table[407] = "Proxy Authentication Required";
+    table[408] = "Request Timeout";
+    table[409] = "Conflict";
+
+    table[410] = "Gone";
+    table[411] = "Length Required";
+    table[412] = "Precondition Failed";
+    table[413] = "Payload Too Large";
+    table[414] = "URI Too Long";
+    table[415] = "Unsupported Media Type";
+    table[416] = "Range Not Satisfiable";
+    table[417] = "Expectation Failed";
+    table[418] = "I'm a teapot";
+
+    table[421] = "Misdirected Request";
+    table[422] = "Unprocessable Entity";
+    table[423] = "Locked";
+    table[424] = "Failed Dependency";
+    table[425] = "Too Early";
+    table[426] = "Upgrade Required";
+    table[428] = "Precondition Required";
+    table[429] = "Too Many Requests";
+
+    table[431] = "Request Header Fields Too Large";
+    table[451] = "Unavailable For Legal Reasons";
 
 
     // 5xx server errors
-    {500, "Internal Server Error"},
-    {501, "Not Implemented"},
-    {502, "Bad Gateway"},
-    {503, "Service Unavailable"},
-    {504, "Gateway Timeout"},
-    {505, "HTTP Version Not Supported"},
-    {506, "Variant Also Negotiates"},
-    {507, "Insufficient Storage"},
-    {508, "Loop Detected"},
-    {510, "Not Extended"},
-    {511, "Network Authentication Required"},
-};
+    table[500] = "Internal Server Error";
+    table[501] = "Not Implemented";
+    table[502] = "Bad Gateway";
+    table[503] = "Service Unavailable";
+    table[504] = "Gateway Timeout";
+    table[505] = "HTTP Version Not Supported";
+    table[506] = "Variant Also Negotiates";
+    table[507] = "Insufficient Storage";
+    table[508] = "Loop Detected";
+    table[510] = "Not Extended";
+    table[511] = "Network Authentication Required";
+    return table;
+}();
 
 const std::unordered_map<std::string_view, std::string_view> extension_lookup_table {
     {"html", "text/html"},
@@ -197,24 +204,34 @@ const std::unordered_map<std::string_view, std::string_view> extension_lookup_ta
     {"wasm", "application/wasm"},
 };
 
+template<std::size_t N, typename T>
+std::string_view to_chars(std::array<char, N>& buf, T value) {
+    auto res = std::to_chars(buf.data(), buf.data() + buf.size(), value);
+    return {buf.data(), static_cast<std::size_t>(res.ptr - buf.data())};
 }
 
-Response::Response(Error const& from_error, ErrorBodyGenerator pageGenerator)
+}
+
+Response::Response(Status status, ErrorBodyGenerator pageGenerator)
   : Response{}
 {
-    status_code = from_error.code();
+    status_code = status.code;
 
     if (pageGenerator) {
-        std::string body = pageGenerator(status_code, from_error.what());
+        std::string body = pageGenerator(status_code, status.message);
         message_body.emplace();
         std::transform(begin(body), end(body), std::back_inserter(*message_body), [](char c) { return std::byte{static_cast<unsigned char>(c)}; });
     } else {
-        std::string_view what{from_error.what()};
+        std::string_view what{status.message};
         message_body.emplace();
         std::transform(begin(what), end(what), std::back_inserter(*message_body), [](char c) { return std::byte{static_cast<unsigned char>(c)}; });
     }
 }
 
+Response::Response(Error const& from_error, ErrorBodyGenerator pageGenerator)
+  : Response{Status{from_error.code(), from_error.what()}, std::move(pageGenerator)}
+{}
+
 void Response::setCookie(std::string_view name, std::string_view value, CookieAttributes attributes) {
     std::string val = std::string{name} + "=" + std::string{value};
     if (auto expires = std::get_if<struct tm>(&attributes.lifetime); expires) {
@@ -240,50 +257,94 @@ void Response::setCookie(std::string_view name, std::string_view value, CookieAt
 }
 
 std::vector<std::byte> Response::serialize() const {
-    using namespace std::string_view_literals;
+    // a guess that covers the header of most responses, serialize(out) reserves the exact size anyway
+    std::vector<std::byte> serialized = acquire_buffer((message_body and payloads.empty() ? message_body->size() : 0) + 512);
+    serialize(serialized);
+    return serialized;
+}
 
-    std::vector<std::byte> serialized;
-    auto append_str = [](std::vector<std::byte>& target, auto const& str) {
-        std::transform(begin(str), end(str), std::back_inserter(target), [](char c) { return std::byte{static_cast<unsigned char>(c)}; });
-    };
+void Response::serialize(std::vector<std::byte>& out) const {
+    std::string_view reason = reason_phrase;
+    if (reason.empty() and status_code >= 0 and status_code < static_cast<int>(code2reason.size())) {
+        reason = code2reason[status_code];
+    }
 
-    append_str(serialized, version);
-    append_str(serialized, " "sv);
-    append_str(serialized, std::to_string(status_code));
-    append_str(serialized, " "sv);
+    std::array<char, 12> code_buf;
+    auto code_str = to_chars(code_buf, status_code);
 
-    if (reason_phrase.empty()) {
-        append_str(serialized, code2reason.at(status_code));
-    } else {
-        append_str(serialized, reason_phrase);
+    // compute the exact size first so that out is allocated (at most) once
+    bool has_content_length = fields.count(Field::content_length) != 0;
+    bool has_date = fields.count(Field::date) != 0;
+    std::size_t size = version.size() + 1 + code_str.size() + 1 + reason.size() + 2;
+    for (auto const& [name, val] : fields) {
+        size += name.size() + 2 + val.size() + 2;
     }
-    append_str(serialized, "\r\n"sv);
 
-    for (auto const& [name, val] : fields) {
-        append_str(serialized, name);
-        append_str(serialized, ": "sv);
-        append_str(serialized, val);
-        append_str(serialized, "\r\n"sv);
+    std::string_view date_str;
+    if (not has_date) {
+        date_str = current_datestr();
+        size += "Date: "sv.size() + date_str.size() + 2;
     }
 
-    if (message_body and fields.find("Content-Length") == fields.end()) {
-        append_str(serialized, "Content-Length: "sv);
-        append_str(serialized, std::to_string(message_body->size()));
-        append_str(serialized, "\r\n"sv);
+    std::array<char, 24> length_buf;
+    std::string_view length_str;
+    if (not payloads.empty() and not has_content_length) {
+        std::size_t length{0};
+        for (auto const& payload : payloads) {
+            length += payload_size(payload);
+        }
+        length_str = to_chars(length_buf, length);
+        size += "Content-Length: "sv.size() + length_str.size() + 2;
+    } else if (message_body and not has_content_length) {
+        length_str = to_chars(length_buf, message_body->size());
+        size += "Content-Length: "sv.size() + length_str.size() + 2;
+    }
+    size += 2;
+    if (message_body and payloads.empty()) {
+        size += message_body->size();
     }
-    append_str(serialized, "\r\n"sv);
+    out.reserve(out.size() + size);
+
+    auto append = [&out](std::string_view str) {
+        auto const* data = reinterpret_cast<std::byte const*>(str.data());
+        out.insert(out.end(), data, data + str.size());
+    };
+
+    append(version);
+    append(" "sv);
+    append(code_str);
+    append(" "sv);
+    append(reason);
+    append("\r\n"sv);
 
-    if (message_body) {
-        serialized.insert(serialized.end(), message_body->begin(), message_body->end());
+    for (auto const& [name, val] : fields) {
+        append(name);
+        append(": "sv);
+        append(val);
+        append("\r\n"sv);
     }
 
-    return serialized;
+    if (not date_str.empty()) {
+        append("Date: "sv);
+        append(date_str);
+        append("\r\n"sv);
+    }
+    if (not length_str.empty()) {
+        append("Content-Length: "sv);
+        append(length_str);
+        append("\r\n"sv);
+    }
+    append("\r\n"sv);
+
+    if (message_body and payloads.empty()) {
+        out.insert(out.end(), message_body->begin(), message_body->end());
+    }
 }
 
 
 void Response::setContentTypeFromExtension(std::string_view extension) {
-    fields.erase("Content-Type");
-    fields.emplace("Content-Type", contentTypeLookup(extension));
+    fields.erase(Field::content_type);
+    fields.emplace("Content-Type", std::string{contentTypeLookup(extension)});
 }
 
 std::string_view Response::contentTypeLookup(std::string_view extension) {
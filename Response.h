@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Error.h"
+#include "HeaderFields.h"
+#include "Payload.h"
 #include "unique_function.h"
 
 #include <map>
@@ -33,11 +35,14 @@ struct Response {
     std::string version {"HTTP/1.1"};
     int status_code {200};
     std::string reason_phrase {""}; // if empty, will be auto filled
-    std::multimap<std::string, std::string> fields{{"Content-Type", "text/html, charset=utf-8"}};
+    HeaderFields fields{{"Content-Type", "text/html, charset=utf-8"}};
 
     std::optional<MessageBody> message_body;
+    // if not empty, these are sent (in order) as body instead of message_body and are not copied into the serialized response
+    std::vector<Payload> payloads;
 
     Response() = default;
+    Response(Status status, ErrorBodyGenerator pageGenerator={});
     Response(Error const& from_error, ErrorBodyGenerator pageGenerator={});
 
     template<typename CharT>
@@ -61,7 +66,10 @@ struct Response {
     
     static std::string_view contentTypeLookup(std::string_view extension);
 
+    // payloads are not part of the serialized response and need to be sent separately
     std::vector<std::byte> serialize() const;
+    // appends the serialized response to out
+    void serialize(std::vector<std::byte>& out) const;
 };
 
 struct AsyncResponse {
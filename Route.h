@@ -6,7 +6,9 @@
 #include "Request.h"
 #include "Response.h"
 
+#include <algorithm>
 #include <charconv>
+#include <functional>
 #include <optional>
 #include <regex>
 #include <string>
@@ -22,6 +24,9 @@ using OptResponse = std::optional<Response>;
 struct RouteBase {
     struct Options {
         std::vector<std::string> methods{"GET"};
+        // called right after the header of a request was received, before its body, returning a Status (e.g., 401) rejects the request
+        // stream routes call it for every request, the others when the client waits for a go-ahead (Expect: 100-continue)
+        std::function<std::optional<Status>(Request const&)> can_accept{};
     };
     RouteBase(std::regex pattern, Options options) noexcept 
     : m_pattern{std::move(pattern)}
@@ -45,6 +50,19 @@ struct RouteBase {
 
     virtual OptResponse operator()(Request const& request, std::cmatch const& match) = 0;
 
+    bool allowsMethod(std::string_view method) const {
+        return std::find(begin(m_options.methods), end(m_options.methods), method) != std::end(m_options.methods);
+    }
+
+    // the Status to answer a request with if it would be rejected before its body was received
+    // (i.e., what the can_accept hook returns), the Dispatcher has checked the method already
+    virtual std::optional<Status> canAccept(Request const& request) const {
+        if (m_options.can_accept) {
+            return m_options.can_accept(request);
+        }
+        return std::nullopt;
+    }
+
     Options const& getOptions() const {
         return m_options;
     }
@@ -104,10 +122,8 @@ public:
 
     virtual ~Route() = default;
 
+    // the Dispatcher only calls a route for the methods it allows (and for HEAD if it allows GET)
     OptResponse operator()(Request const& request, std::cmatch const& match) override {
-        if (std::find(begin(m_options.methods), end(m_options.methods), request.header.method) == std::end(m_options.methods)) {
-            throw Error(405);
-        }
         ParameterTuple args;
         if (extract<0>(match, args)) {
             return invoke(request, args, std::index_sequence_for<Args...>());
@@ -1,34 +1,100 @@
 #include "Server.h"
 
 #include "ConnectionHandler.h"
+#include "FileReader.h"
+#include "IOUring.h"
+#include "UringLoop.h"
+
+#include <simplyfile/Timer.h>
 
 #include <list>
+#include <optional>
 
 namespace cndl {
 
 struct Server::Pimpl {
     Dispatcher dispatcher;
+    Options options;
 
     std::list<simplyfile::ServerSocket> server_sockets;
+    // only set when io_uring is requested and supported (declared after server_sockets as it accepts from them)
+    std::unique_ptr<UringLoop> uring;
+    // declared after uring as its completions schedule connections of the ring
+    std::unique_ptr<FileReader> file_reader;
+
+    // drives the idle sweep (see ServerOptions::idle_reclaim_after), armed on the first listen
+    std::optional<simplyfile::Timer> reclaim_timer;
 
     simplyfile::Epoll& m_epoll;
-    Pimpl(simplyfile::Epoll& epoll) : m_epoll{epoll} {
+    Pimpl(simplyfile::Epoll& epoll, Options i_options) : options{std::move(i_options)}, m_epoll{epoll} {
     }
 
     ~Pimpl() {
+        if (reclaim_timer) {
+            m_epoll.rmFD(*reclaim_timer, true);
+        }
         for (auto& ss : server_sockets) {
             m_epoll.rmFD(ss, true);
         }
     }
 
+    void startReclaiming() {
+        if (reclaim_timer or options.idle_reclaim_after.count() == 0) {
+            return;
+        }
+        reclaim_timer.emplace(std::max(options.idle_reclaim_after / 2, std::chrono::milliseconds{1}));
+        m_epoll.addFD(*reclaim_timer, [this](int) {
+            reclaim_timer->getElapsed();
+            ConnectionHandler::reclaimIdle(options);
+        }, EPOLLIN|EPOLLET, "cndl::reclaim");
+    }
+
+    FileReader* getFileReader() {
+        if (not file_reader and options.file_read_threads > 0) {
+            file_reader = std::make_unique<FileReader>(options.file_read_threads);
+        }
+        return file_reader.get();
+    }
+
+    UringLoop* getUringLoop() {
+        if (options.io_backend != IOBackend::io_uring) {
+            return nullptr;
+        }
+        if (not uring) {
+            if (not IOUring::available()) {
+                options.io_backend = IOBackend::epoll;
+                return nullptr;
+            }
+            try {
+                uring = std::make_unique<UringLoop>(m_epoll, dispatcher, options, getFileReader());
+            } catch (std::system_error const&) {
+                // e.g., when io_uring is disabled or the memory for its buffers cannot be locked
+                options.io_backend = IOBackend::epoll;
+                return nullptr;
+            }
+        }
+        return uring.get();
+    }
+
     void listen(simplyfile::Host const& host, int backlog) {
         auto& ss = server_sockets.emplace_back(host);
         ss.setFlags(O_NONBLOCK);
-        m_epoll.addFD(ss, [this, &ss](int flags) {
+        // created here and not lazily on accept (which happens on any thread of the loop)
+        auto* reader = getFileReader();
+        startReclaiming();
+        if (auto* ring = getUringLoop(); ring) {
+            ss.listen(backlog);
+            ring->listen(ss);
+            return;
+        }
+        bool edge_triggered = options.io_mode == IOMode::edge_triggered;
+        int ss_flags = edge_triggered ? EPOLLIN|EPOLLET : EPOLLIN|EPOLLONESHOT;
+        m_epoll.addFD(ss, [this, &ss, reader, edge_triggered, ss_flags](int flags) {
             if (flags != EPOLLIN) {
                 m_epoll.rmFD(ss, false);
                 return;
             }
+            // accept until the backlog is drained (in edge triggered mode there is no further notification otherwise)
             while (true) {
                 auto client = ss.accept();
                 if (not client.valid()) {
@@ -37,19 +103,21 @@ struct Server::Pimpl {
                 client.setFlags(O_NONBLOCK);
 
                 int fd = client;
-                m_epoll.addFD(fd, ConnectionHandler{std::move(client), m_epoll, dispatcher}, EPOLLIN|EPOLLHUP|EPOLLRDHUP|EPOLLONESHOT, "cndl::io");
+                m_epoll.addFD(fd, ConnectionHandler{std::move(client), m_epoll, dispatcher, options, reader}, ConnectionHandler::epollFlags(options.io_mode), "cndl::io");
+            }
+            if (not edge_triggered) {
+                m_epoll.modFD(ss, ss_flags);
             }
-            m_epoll.modFD(ss, EPOLLIN|EPOLLONESHOT);
-        }, EPOLLIN|EPOLLONESHOT, "cndl::accept");
+        }, ss_flags, "cndl::accept");
         ss.listen(backlog);
     }
 };
 
 
-Server::Server(simplyfile::Epoll& epoll) : pimpl{std::make_unique<Pimpl>(epoll)} {
+Server::Server(simplyfile::Epoll& epoll, Options options) : pimpl{std::make_unique<Pimpl>(epoll, std::move(options))} {
 }
 
-Server::Server(simplyfile::Host const& host, simplyfile::Epoll& epoll, int backlog) : pimpl{std::make_unique<Pimpl>(epoll)} {
+Server::Server(simplyfile::Host const& host, simplyfile::Epoll& epoll, int backlog, Options options) : pimpl{std::make_unique<Pimpl>(epoll, std::move(options))} {
     pimpl->listen(host, backlog);
 }
 
@@ -65,6 +133,10 @@ Dispatcher& Server::getDispatcher() {
     return pimpl->dispatcher;
 }
 
+Server::Options& Server::getOptions() {
+    return pimpl->options;
+}
+
 void Server::listen(simplyfile::Host const& host, int backlog) {
     pimpl->listen(host, backlog);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Dispatcher.h"
+#include "ServerOptions.h"
 
 #include <simplyfile/Epoll.h>
 #include <simplyfile/socket/Host.h>
@@ -10,8 +11,10 @@
 namespace cndl {
 
 struct Server {
-    Server(simplyfile::Host const& host, simplyfile::Epoll& epoll, int backlog=0);
-    Server(simplyfile::Epoll& epoll);
+    using Options = ServerOptions;
+
+    Server(simplyfile::Host const& host, simplyfile::Epoll& epoll, int backlog=0, Options options={});
+    Server(simplyfile::Epoll& epoll, Options options={});
     ~Server();
     Server(Server&&) noexcept;
     Server& operator=(Server&&) noexcept;
@@ -20,6 +23,9 @@ struct Server {
 
     Dispatcher& getDispatcher();
 
+    // the options have to be adjusted before listen is called
+    Options& getOptions();
+
     simplyfile::Epoll& getEpoll();
 
     // returns a singleton for applications where the routing shall be done globally
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace cndl {
+
+enum class IOMode {
+    oneshot,        // sockets are registered with EPOLLONESHOT and rearmed after every event
+    edge_triggered, // sockets are registered edge triggered once, no rearming (epoll_ctl) per event
+};
+
+enum class IOBackend {
+    epoll,    // readiness based IO (recv/send whenever epoll reports a socket to be ready)
+    io_uring, // completion based IO (multishot accept and recv, linked sends), falls back to epoll if the kernel lacks support
+              // the ring is driven by one thread at a time, so all requests of a server are handled on a single thread
+};
+
+struct ServerOptions {
+    IOMode io_mode{IOMode::oneshot};
+    // with io_uring the server is effectively single-threaded: every completion of the ring, and with it every route handler
+    // of the server, runs on whichever loop thread drives the ring, one at a time (more loop threads do not add throughput)
+    IOBackend io_backend{IOBackend::epoll};
+    // file regions (e.g., big static files) are sent from the IO loop with sendfile, which stalls the loop while it reads from disk
+    // with file_read_threads > 0, parts that are not in the page cache are read by this many threads and sent from memory
+    // instead (cached parts are still sent with sendfile, at the cost of a probe with mmap and mincore per 256KiB)
+    unsigned file_read_threads{0};
+
+    // requests whose header does not fit are answered with 431, bodies that are bigger with 413 (before they are received)
+    std::size_t max_header_size{64 * 1024};
+    std::size_t max_body_size{16 * 1024 * 1024};
+    // the limit for bodies that are not buffered: those taken by a StreamRoute and multipart/* bodies bigger than multipart_spool_threshold
+    // (which are parsed while they are received, their parts that are bigger than that are spooled to unnamed temporary files
+    // in spool_directory; empty: the system's temp directory)
+    std::size_t max_streamed_body_size{std::size_t{4} * 1024 * 1024 * 1024};
+    std::size_t multipart_spool_threshold{256 * 1024};
+    std::string spool_directory{};
+
+    // connections that have neither received nor sent anything for that long give back their buffers (to the buffer pool
+    // of their IO loop or to the allocator) so that memory follows the traffic and not its peaks, 0 (the default) disables it
+    // the server looks for idle connections every half of that (e.g., 10s is a sensible value for many mostly idle clients)
+    std::chrono::milliseconds idle_reclaim_after{0};
+};
+
+}
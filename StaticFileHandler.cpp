@@ -1,8 +1,15 @@
 #include "StaticFileHandler.h"
+#include "ContentEncoding.h"
 #include "DateStrHelper.h"
+#include "ETag.h"
+#include "FileCache.h"
+#include "HeaderFields.h"
 
-#include <simplyfile/FileDescriptor.h>
-
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <optional>
+#include <random>
 #include <string_view>
 
 #include <sys/stat.h>
@@ -24,83 +31,269 @@ private:
 template<typename Func>
 Finally(Func && f) -> Finally<Func>;
 
+struct ByteRange {
+    std::uint64_t first;
+    std::uint64_t last; // inclusive
+};
+
+// more ranges than that in a single request are not worth the effort (and are a typical pattern of abuse)
+constexpr std::size_t max_ranges = 16;
+
+struct ByteRanges {
+    std::array<ByteRange, max_ranges> ranges;
+    std::size_t count{0};
+};
+
+enum class RangeResult {
+    ignored,       // no (valid) range: the whole representation is sent
+    satisfiable,
+    unsatisfiable,
+};
+
+std::optional<std::uint64_t> parse_uint(std::string_view str) {
+    std::uint64_t value;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (str.empty() or ec != std::errc{} or ptr != str.data() + str.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// parses a Range header (RFC 7233) for a representation of size bytes
+// ranges that start beyond the end are skipped, the others are clipped to the size
+RangeResult parse_ranges(std::string_view header, std::uint64_t size, ByteRanges& out) {
+    constexpr std::string_view unit = "bytes=";
+    if (header.size() < unit.size() or not detail::ignore_case_equal(header.substr(0, unit.size()), unit)) {
+        return RangeResult::ignored;
+    }
+    header.remove_prefix(unit.size());
+    out.count = 0;
+    bool any_spec{false};
+    while (not header.empty()) {
+        auto comma = header.find(',');
+        auto spec = detail::trim(header.substr(0, comma));
+        header = comma == std::string_view::npos ? std::string_view{} : header.substr(comma + 1);
+        if (spec.empty()) {
+            continue;
+        }
+        any_spec = true;
+        auto dash = spec.find('-');
+        if (dash == std::string_view::npos) {
+            return RangeResult::ignored;
+        }
+        auto first_str = detail::trim(spec.substr(0, dash));
+        auto last_str  = detail::trim(spec.substr(dash + 1));
+        ByteRange range;
+        if (first_str.empty()) {
+            // suffix range: the last n bytes
+            auto suffix = parse_uint(last_str);
+            if (not suffix) {
+                return RangeResult::ignored;
+            }
+            if (*suffix == 0 or size == 0) {
+                continue;
+            }
+            range = {size - std::min(*suffix, size), size - 1};
+        } else {
+            auto first = parse_uint(first_str);
+            auto last  = last_str.empty() ? std::optional<std::uint64_t>{size - 1} : parse_uint(last_str);
+            if (not first or not last or (not last_str.empty() and *last < *first)) {
+                return RangeResult::ignored;
+            }
+            if (*first >= size) {
+                continue;
+            }
+            range = {*first, std::min(*last, size - 1)};
+        }
+        if (out.count == out.ranges.size()) {
+            return RangeResult::ignored;
+        }
+        out.ranges[out.count++] = range;
+    }
+    if (not any_spec) {
+        return RangeResult::ignored;
+    }
+    return out.count == 0 ? RangeResult::unsatisfiable : RangeResult::satisfiable;
+}
+
+std::string make_boundary() {
+    thread_local std::mt19937_64 engine{std::random_device{}()};
+    return fmt::format("cndl-{:016x}", engine());
+}
+
+ByteBuf to_bytes(std::string_view str) {
+    auto const* data = reinterpret_cast<std::byte const*>(str.data());
+    return ByteBuf{data, data + str.size()};
+}
+
+// what is sent for a request: the file itself, a precompressed sibling or the file compressed on the fly
+struct Representation {
+    FileCache::EntryPtr file;
+    SharedBuf content;          // the content if it is in memory
+    std::string_view encoding{};
+    bool varies{false};         // whether another Accept-Encoding could have led to a different representation
+};
+
+Representation negotiate(FileCache& cache, Request const& request, std::string const& path, FileCache::EntryPtr const& file) {
+    std::string accept_encoding;
+    auto [it, end] = request.header.fields.equal_range(Field::accept_encoding);
+    for (; it != end; ++it) {
+        accept_encoding += it->second + ",";
+    }
+
+    Representation rep{file, file->content};
+    // precompressed siblings are only used if they are not older than the file itself
+    for (auto [encoding, extension] : precompressed_siblings) {
+        auto sibling = cache.lookup(path + std::string{extension});
+        if (not sibling or sibling->stat.st_mtim.tv_sec < file->stat.st_mtim.tv_sec) {
+            continue;
+        }
+        rep.varies = true;
+        if (rep.encoding.empty() and accepts_encoding(accept_encoding, encoding)) {
+            rep.file     = sibling;
+            rep.content  = sibling->content;
+            rep.encoding = encoding;
+        }
+    }
+    if (rep.encoding.empty() and is_compressible(file->content_type)) {
+        rep.varies = true;
+        if (accepts_encoding(accept_encoding, "gzip")) {
+            if (auto gzipped = cache.gzipped(file)) {
+                rep.content  = std::move(gzipped);
+                rep.encoding = "gzip";
+            }
+        }
+    }
+    return rep;
+}
+
 }
 
-StaticFileHandler::StaticFileHandler(std::filesystem::path bd) 
+StaticFileHandler::StaticFileHandler(std::filesystem::path bd, Options const& options) 
     : base_dir{std::move(bd)}
+    , cache{std::make_shared<FileCache>(options)}
+{}
+
+StaticFileHandler::StaticFileHandler(std::filesystem::path bd, simplyfile::Epoll& epoll, Options const& options)
+    : base_dir{std::move(bd)}
+    , cache{std::make_shared<FileCache>(epoll, options)}
 {}
 
 OptResponse StaticFileHandler::operator()(Request const& request, std::string const& resource) const {
-    auto pat = (base_dir / resource).native();
-    simplyfile::FileDescriptor f{::open(pat.c_str(), O_RDONLY)};
-    if (not f) {
-        throw cndl::Error(404);
-    }
-    struct stat statbuf;
-    if (fstat(f, &statbuf) != 0) {
-        throw cndl::Error(500);
+    auto path = (base_dir / resource).lexically_normal().native();
+    auto file = cache->lookup(path);
+    if (not file) {
+        return std::nullopt;
     }
-    
+
     cndl::Response response;
     response.fields.emplace("cache-control", "max-age=3600, no-cache");
-    response.fields.emplace("last-modified", mkdatestr(statbuf.st_mtim));
+    response.fields.emplace("last-modified", file->last_modified);
     response.fields.emplace("Accept-Ranges", "bytes");
-    response.setContentTypeFromExtension(std::filesystem::path{resource}.extension().native());
-
-    if (auto it = request.header.fields.find("if-modified-since"); it != request.header.fields.end()) {
-        auto req_tm = parsedatestr(it->second);
-        time_t req_time = mktime(&req_tm);
-        if (req_time >= statbuf.st_mtim.tv_sec) {
-            response.status_code = 304;
-            return response;
+    response.fields.erase(Field::content_type);
+    response.fields.emplace("Content-Type", file->content_type);
+
+    auto rep = negotiate(*cache, request, path, file);
+    if (rep.varies) {
+        response.fields.emplace("Vary", "Accept-Encoding");
+    }
+    if (not rep.encoding.empty()) {
+        response.fields.emplace("Content-Encoding", std::string{rep.encoding});
+    }
+
+    // every representation has its own ETag
+    std::string etag = rep.file->etag;
+    if (rep.file == file and not rep.encoding.empty()) {
+        etag.insert(etag.size() - 1, "-" + std::string{rep.encoding});
+    }
+    if (apply_etag(request, response, etag)) {
+        return response;
+    }
+    // If-Modified-Since is only looked at if there is no If-None-Match
+    if (request.header.fields.count(Field::if_none_match) == 0) {
+        if (auto it = request.header.fields.find(Field::if_modified_since); it != request.header.fields.end()) {
+            // most clients send back exactly what they got, that spares us parsing the date
+            bool not_modified = it->second == file->last_modified;
+            if (not not_modified) {
+                auto req_tm = parsedatestr(it->second);
+                not_modified = timegm(&req_tm) >= file->stat.st_mtim.tv_sec;
+            }
+            if (not_modified) {
+                response.status_code = 304;
+                return response;
+            }
         }
     }
+    // ranges refer to the selected representation (i.e., the compressed bytes if it is encoded)
+    std::size_t size = rep.content ? rep.content->size() : static_cast<std::size_t>(rep.file->stat.st_size);
 
     if (request.header.method == "HEAD") {
-        response.fields.emplace("Content-Length", std::to_string(statbuf.st_size));
+        response.fields.emplace("Content-Length", std::to_string(size));
         return response;
     }
 
-    std::size_t start_offset = 0;
-    std::size_t end_offset   = statbuf.st_size;
-    auto [it, end] = request.header.fields.equal_range("range");
-    for (; it != end; ++it) {
-        auto const& val = it->second;
-        const std::regex reg{R"(bytes=(\d+)-(\d*))"};
-        std::smatch match;
-        if (std::regex_match(val, match, reg, std::regex_constants::format_first_only)) {
-            start_offset = std::min<std::size_t>(statbuf.st_size, std::stoi(match[1]));
-            if (match[2].length()) {
-                end_offset   = std::min<std::size_t>(statbuf.st_size, std::stoi(match[2]));
+    // a piece of the selected representation
+    auto part = [&](std::uint64_t offset, std::uint64_t length) -> Payload {
+        if (rep.content) {
+            if (offset == 0 and length == rep.content->size()) {
+                // the cached content is shared by all responses that carry it
+                return rep.content;
             }
-            if (start_offset > end_offset) {
-                throw cndl::Error(400);
-            }
-            if (start_offset != 0 or end_offset != statbuf.st_size) {
-                response.status_code = 206;
-                response.fields.emplace("Content-Range", fmt::format("bytes {}-{}/{}", start_offset, end_offset - 1, statbuf.st_size));
-            }
-            break;
+            auto range = std::span{*rep.content}.subspan(offset, length);
+            return ByteBuf{range.begin(), range.end()};
         }
+        return FileRegion{
+            .fd     = rep.file->fd,
+            .offset = offset,
+            .length = length,
+            .owner  = rep.file,
+        };
+    };
+
+    ByteRanges ranges;
+    auto range_it = request.header.fields.find(Field::range);
+    auto parsed = range_it == request.header.fields.end() ? RangeResult::ignored : parse_ranges(range_it->second, size, ranges);
+    if (parsed == RangeResult::unsatisfiable) {
+        response.status_code = 416;
+        response.fields.emplace("Content-Range", fmt::format("bytes */{}", size));
+        response.message_body.emplace();
+        return response;
+    }
+    if (parsed == RangeResult::ignored) {
+        response.payloads.emplace_back(part(0, size));
+        return response;
+    }
+
+    response.status_code = 206;
+    if (ranges.count == 1) {
+        auto const& range = ranges.ranges[0];
+        response.fields.emplace("Content-Range", fmt::format("bytes {}-{}/{}", range.first, range.last, size));
+        response.payloads.emplace_back(part(range.first, range.last - range.first + 1));
+        return response;
     }
 
-    response.message_body.emplace();
-    response.message_body->resize(end_offset - start_offset);
-    auto bytes_read = ::pread(f, response.message_body->data(), response.message_body->size(), start_offset);
-    if (bytes_read != static_cast<std::int64_t>(response.message_body->size())) {
-        throw cndl::Error(500);
+    // multipart/byteranges: the parts are sent one after the other, each one preceded by its header
+    auto boundary = make_boundary();
+    auto content_type = response.fields.find(Field::content_type)->second;
+    response.fields.erase(Field::content_type);
+    response.fields.emplace("Content-Type", "multipart/byteranges; boundary=" + boundary);
+    for (std::size_t i{0}; i < ranges.count; ++i) {
+        auto const& range = ranges.ranges[i];
+        auto part_header = fmt::format("{}--{}\r\nContent-Type: {}\r\nContent-Range: bytes {}-{}/{}\r\n\r\n",
+            i == 0 ? "" : "\r\n", boundary, content_type, range.first, range.last, size);
+        response.payloads.emplace_back(to_bytes(part_header));
+        response.payloads.emplace_back(part(range.first, range.last - range.first + 1));
     }
+    response.payloads.emplace_back(to_bytes(fmt::format("\r\n--{}--\r\n", boundary)));
     return response;
 }
 
 bool StaticFileHandler::can_serve_resource(std::string const& resource) const {
-    auto pat = (base_dir / resource).native();
-    std::FILE* f = std::fopen(pat.c_str(), "r");
-    if (not f) {
-        return false;
-    }
-    std::fclose(f);
-    return true;
+    return cache->lookup((base_dir / resource).lexically_normal().native()) != nullptr;
+}
+
+StaticFileHandler::CacheStats StaticFileHandler::getCacheStats() const {
+    return cache->getStats();
 }
 
 }
@@ -2,17 +2,49 @@
 
 #include "Route.h"
 
+#include <simplyfile/Epoll.h>
+
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 
 namespace cndl {
 
+struct FileCache;
+
+struct StaticFileOptions {
+    std::size_t max_open_files{256};
+    // the content of files up to max_cached_file_size is kept in memory, all of it must fit into max_cached_bytes
+    // bigger files are sent straight from the file (sendfile)
+    std::size_t max_cached_bytes{32 * 1024 * 1024};
+    std::size_t max_cached_file_size{256 * 1024};
+    // compressible files up to this size are gzipped on the fly (unless there is a precompressed .br or .gz sibling)
+    // the compressed content is kept in memory, counting against max_cached_bytes
+    std::size_t max_compressed_file_size{4 * 1024 * 1024};
+};
+
 struct StaticFileHandler {
-    StaticFileHandler(std::filesystem::path base_dir);
+    using Options = StaticFileOptions;
+
+    struct CacheStats {
+        std::uint64_t hits{0};
+        std::uint64_t misses{0};
+        std::uint64_t evictions{0};
+        std::size_t cached_files{0};
+        std::size_t cached_bytes{0};
+    };
+
+    StaticFileHandler(std::filesystem::path base_dir, Options const& options={});
+    // the cache of open files is invalidated from within epoll (makes serving a cached file free of metadata syscalls)
+    StaticFileHandler(std::filesystem::path base_dir, simplyfile::Epoll& epoll, Options const& options={});
 
     OptResponse operator()(Request const& request, std::string const& resource) const;
     bool can_serve_resource(std::string const& resource) const;
+
+    CacheStats getCacheStats() const;
 private:
     std::filesystem::path base_dir;
+    std::shared_ptr<FileCache> cache;
 };
 
 }
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Route.h"
+#include "unique_function.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace cndl {
+
+// receives the body of a request piece by piece while it arrives, instead of after it was buffered completely (see StreamRoute)
+// the callbacks are called from the IO loop of the connection, the request passed to the route stays valid until onEnd or onAbort
+struct BodyReader {
+    virtual ~BodyReader() = default;
+
+    // the next piece of the body
+    virtual void onData(std::span<std::byte const> data) = 0;
+    // the body was received completely, returns the response to the request (std::nullopt results in a 404)
+    virtual OptResponse onEnd() = 0;
+    // the body will not be received completely (the connection broke, or the body was malformed or too big)
+    virtual void onAbort() {}
+
+    // flow control: after pause (called from within onData) nothing is read from the connection until resume is called
+    // (i.e., the sender is slowed down by TCP), resume can be called from any thread
+    void pause() noexcept {
+        paused = true;
+    }
+    void resume() {
+        if (paused.exchange(false) and on_resume) {
+            on_resume();
+        }
+    }
+    bool isPaused() const noexcept {
+        return paused;
+    }
+
+private:
+    friend struct HttpProtocol;
+    std::atomic<bool> paused{false};
+    unique_func<void()> on_resume;
+};
+
+struct StreamRouteBase {
+    using Options = RouteBase::Options;
+
+    StreamRouteBase(std::regex pattern, Options options) noexcept
+    : m_pattern{std::move(pattern)}
+    , m_options{std::move(options)}
+    {}
+
+    virtual ~StreamRouteBase() = default;
+
+    std::optional<std::cmatch> match(Request const& request) const {
+        auto resource = std::string_view{request.header.resource};
+        std::cmatch res;
+        if (std::regex_match(begin(resource), end(resource), res, m_pattern)) {
+            return res;
+        }
+        return {};
+    }
+
+    // called as soon as the header of a matching request was received (request.message_body is empty)
+    // returning nullptr leaves the request to the regular routes
+    virtual std::unique_ptr<BodyReader> operator()(Request const& request, std::cmatch const& match) = 0;
+
+    Options const& getOptions() const {
+        return m_options;
+    }
+
+protected:
+    std::regex m_pattern;
+    Options m_options;
+};
+
+template <typename T>
+struct StreamRoute;
+
+// a route for requests whose body is processed while it is received (e.g., big uploads that are hashed or passed on)
+//     cndl::StreamRoute upload{std::regex{"/upload/(.+)"}, [](cndl::Request const& request, std::string name) {
+//         return std::make_unique<HashingReader>(name);
+//     }, {.methods={"PUT", "POST"}}};
+//     server.getDispatcher().addRoute(upload);
+template <typename... Args>
+struct StreamRoute<std::unique_ptr<BodyReader>(Request const&, Args...)> : StreamRouteBase {
+protected:
+    using ParameterTuple = std::tuple<std::remove_cv_t<std::remove_reference_t<Args>>...>;
+    using FuncT = unique_func<std::unique_ptr<BodyReader>(Request const&, Args...)>;
+    FuncT m_ftor;
+
+    template<std::size_t... indexes>
+    std::unique_ptr<BodyReader> invoke(Request const& request, ParameterTuple const& params, std::index_sequence<indexes...>) {
+        return m_ftor(request, std::get<indexes>(params)...);
+    }
+
+    template<int idx, typename MatchResults>
+    bool extract(MatchResults const& match_results, ParameterTuple& params) {
+        if constexpr (idx < sizeof...(Args)) {
+            using ArgType = std::tuple_element_t<idx, ParameterTuple>;
+            auto const& sub_match = match_results[idx+1];
+            return Extractor<ArgType>::extract(sub_match, std::get<idx>(params)) and
+                    extract<idx+1>(match_results, params);
+        } else {
+            return true;
+        }
+    }
+
+public:
+    StreamRoute(std::regex pattern, FuncT ftor, Options options={})
+      : StreamRouteBase{std::move(pattern), std::move(options)}
+      , m_ftor{std::move(ftor)}
+    {
+        if (sizeof...(Args) != m_pattern.mark_count()) {
+            throw std::invalid_argument("got invalid pattern; expected " +
+                 std::to_string(sizeof...(Args)) +
+                 " markers but got " + std::to_string(m_pattern.mark_count()));
+        }
+    }
+
+    StreamRoute(std::string pattern, FuncT ftor, Options options={})
+      : StreamRoute(std::regex{pattern}, std::move(ftor), std::move(options))
+    {}
+
+    std::unique_ptr<BodyReader> operator()(Request const& request, std::cmatch const& match) override {
+        ParameterTuple args;
+        if (extract<0>(match, args)) {
+            return invoke(request, args, std::index_sequence_for<Args...>());
+        }
+        throw Error(500);
+    }
+};
+
+template <typename _Functor,
+          typename _Signature = typename detail::__function_guide_helper<
+              decltype(&_Functor::operator())>::type>
+StreamRoute(std::regex, _Functor, RouteBase::Options={})->StreamRoute<_Signature>;
+
+}
@@ -0,0 +1,258 @@
+#include "UringLoop.h"
+
+#include <cerrno>
+#include <sys/socket.h>
+
+namespace cndl {
+
+namespace {
+
+constexpr unsigned ring_entries     = 256;
+constexpr unsigned recv_buffers     = 256; // must be a power of two
+constexpr std::size_t recv_buf_size = 16 * 1024;
+// the maximum number of sends that are linked together
+constexpr std::size_t max_chain_len = 64;
+// how long accepting pauses after it failed (e.g., when the process ran out of file descriptors)
+constexpr __kernel_timespec accept_backoff{.tv_sec = 0, .tv_nsec = 100'000'000};
+
+constexpr std::uint64_t tag(std::uint64_t id, auto op) {
+    return (id << 8) | static_cast<std::uint64_t>(op);
+}
+
+}
+
+UringLoop::UringLoop(simplyfile::Epoll& i_epoll, Dispatcher& i_dispatcher, ServerOptions const& i_options, FileReader* i_file_reader)
+  : epoll{i_epoll}
+  , dispatcher{i_dispatcher}
+  , options{i_options}
+  , file_reader{i_file_reader}
+  , ring{ring_entries, recv_buffers, recv_buf_size}
+{
+    epoll.addFD(ring.getEventFD(), [this](int) {
+        (*this)();
+    }, EPOLLIN|EPOLLET, "cndl::io_uring");
+}
+
+UringLoop::~UringLoop() {
+    epoll.rmFD(ring.getEventFD(), true);
+}
+
+void UringLoop::listen(simplyfile::ServerSocket& ss) {
+    std::lock_guard lock{ring_mutex};
+    listen_fds.emplace_back(ss);
+    submitAccept(listen_fds.size()-1);
+    ring.submit();
+}
+
+void UringLoop::schedule(std::uint64_t id) {
+    scheduled.push(id);
+    std::uint64_t one{1};
+    [[maybe_unused]] auto w = ::write(ring.getEventFD(), &one, sizeof(one));
+}
+
+void UringLoop::operator()() {
+    pending = true;
+    // only one thread at a time drives the ring
+    // if another thread is already at it, it will look at the completions that woke us up
+    while (pending) {
+        if (active.exchange(true)) {
+            return;
+        }
+        pending = false;
+        process();
+        active = false;
+    }
+}
+
+// runs every completion and thus every handler of the ring's connections, while ring_mutex is held
+void UringLoop::process() {
+    std::uint64_t count;
+    while (::read(ring.getEventFD(), &count, sizeof(count)) > 0) {
+    }
+    {
+        std::lock_guard lock{ring_mutex};
+        do {
+            ring.reap([this](io_uring_cqe const& cqe) {
+                handle(cqe);
+            });
+            scheduled.consume([this](std::uint64_t id) {
+                if (auto it = connections.find(id); it != connections.end()) {
+                    it->second.handler.onWakeup();
+                    dropIfDone(id);
+                }
+            });
+        } while (not scheduled.empty());
+        // everything that was queued while handling the completions goes to the kernel with one syscall
+        ring.submit();
+    }
+}
+
+void UringLoop::handle(io_uring_cqe const& cqe) {
+    auto id = cqe.user_data >> 8;
+    auto op = static_cast<Op>(cqe.user_data & 0xff);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if (op == Op::accept) {
+        if (cqe.res >= 0) {
+            simplyfile::ClientSocket client{cqe.res};
+            auto conn_id = next_id++;
+            auto [it, inserted] = connections.try_emplace(conn_id, Connection{
+                ConnectionHandler{std::move(client), epoll, dispatcher, options, file_reader, *this, conn_id},
+                cqe.res
+            });
+            submitRecv(conn_id, it->second.fd);
+        }
+        if (not more) {
+            if (cqe.res < 0 and cqe.res != -ECONNABORTED and cqe.res != -EINTR) {
+                // accepting right away would fail again (and again), e.g., with EMFILE until some connection is closed
+                submitAcceptBackoff(id);
+            } else {
+                submitAccept(id);
+            }
+        }
+        return;
+    }
+    if (op == Op::accept_backoff) {
+        submitAccept(id);
+        return;
+    }
+    if (op == Op::cancel) {
+        // the cancelled receive completes on its own
+        return;
+    }
+
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    auto& conn = it->second;
+
+    if (op == Op::recv) {
+        if (cqe.res > 0 and (cqe.flags & IORING_CQE_F_BUFFER)) {
+            auto bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            auto data = ring.buffer(bid, cqe.res);
+            if (not conn.closing) {
+                conn.handler.onReceived({data.data(), data.size()});
+            }
+            ring.recycleBuffer(bid);
+        }
+        if (not more) {
+            conn.receiving = false;
+            if (not conn.closing) {
+                if (cqe.res > 0 or cqe.res == -ENOBUFS or cqe.res == -ECANCELED) {
+                    // the kernel terminated the multishot receive (e.g., when it ran out of buffers) or we cancelled it
+                    if (not conn.recv_paused) {
+                        submitRecv(id, conn.fd);
+                    }
+                } else {
+                    conn.handler.onPeerClose();
+                }
+            }
+        }
+    } else if (op == Op::send) {
+        --conn.sending;
+        conn.handler.onSent(cqe.res);
+    }
+    dropIfDone(id);
+}
+
+void UringLoop::send(std::uint64_t id, std::deque<TransmitJob> const& jobs) {
+    auto& conn = connections.at(id);
+    // a chain must not be torn apart by an intermediate submit
+    ring.reserve(jobs.size());
+    for (std::size_t i{0}; i < jobs.size(); ++i) {
+        auto const& [payload, bytes_sent, cb] = jobs[i];
+        auto buf = payload_bytes(payload);
+        auto& sqe = ring.getSQE();
+        sqe.opcode    = IORING_OP_SEND;
+        sqe.fd        = conn.fd;
+        sqe.addr      = reinterpret_cast<std::uint64_t>(buf.data() + bytes_sent);
+        sqe.len       = static_cast<std::uint32_t>(buf.size() - bytes_sent);
+        // with MSG_WAITALL a short send is retried by the kernel (otherwise the next link would send too early)
+        sqe.msg_flags = MSG_NOSIGNAL|MSG_WAITALL;
+        sqe.user_data = tag(id, Op::send);
+        if (i+1 < jobs.size()) {
+            sqe.flags |= IOSQE_IO_LINK;
+        }
+    }
+    conn.sending += jobs.size();
+}
+
+std::size_t UringLoop::maxChainLength() const {
+    return std::min<std::size_t>(max_chain_len, ring.getEntries());
+}
+
+void UringLoop::pauseRecv(std::uint64_t id) {
+    auto& conn = connections.at(id);
+    if (conn.recv_paused) {
+        return;
+    }
+    conn.recv_paused = true;
+    if (conn.receiving) {
+        auto& sqe = ring.getSQE();
+        sqe.opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe.addr      = tag(id, Op::recv);
+        sqe.user_data = tag(id, Op::cancel);
+    }
+}
+
+void UringLoop::resumeRecv(std::uint64_t id) {
+    auto& conn = connections.at(id);
+    conn.recv_paused = false;
+    // if the cancelled receive has not completed yet it is resubmitted when it does
+    if (not conn.receiving and not conn.closing) {
+        submitRecv(id, conn.fd);
+    }
+}
+
+void UringLoop::close(std::uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end() or it->second.closing) {
+        return;
+    }
+    it->second.closing = true;
+    // terminates the multishot receive, the socket is closed when the connection is dropped
+    ::shutdown(it->second.fd, SHUT_RDWR);
+}
+
+void UringLoop::submitAccept(std::size_t listen_idx) {
+    auto& sqe = ring.getSQE();
+    sqe.opcode       = IORING_OP_ACCEPT;
+    sqe.fd           = listen_fds[listen_idx];
+    sqe.ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_NONBLOCK|SOCK_CLOEXEC;
+    sqe.user_data    = tag(listen_idx, Op::accept);
+}
+
+void UringLoop::submitAcceptBackoff(std::size_t listen_idx) {
+    auto& sqe = ring.getSQE();
+    sqe.opcode    = IORING_OP_TIMEOUT;
+    sqe.fd        = -1;
+    sqe.addr      = reinterpret_cast<std::uint64_t>(&accept_backoff);
+    sqe.len       = 1;
+    sqe.user_data = tag(listen_idx, Op::accept_backoff);
+}
+
+void UringLoop::submitRecv(std::uint64_t id, int fd) {
+    auto& sqe = ring.getSQE();
+    sqe.opcode    = IORING_OP_RECV;
+    sqe.fd        = fd;
+    sqe.ioprio    = IORING_RECV_MULTISHOT;
+    sqe.flags     = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = IOUring::buffer_group;
+    sqe.user_data = tag(id, Op::recv);
+    connections.at(id).receiving = true;
+}
+
+void UringLoop::dropIfDone(std::uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+    auto const& conn = it->second;
+    if (conn.closing and not conn.receiving and conn.sending == 0) {
+        connections.erase(it);
+    }
+}
+
+}
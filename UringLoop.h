@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ConnectionHandler.h"
+#include "IOUring.h"
+#include "MPSCQueue.h"
+#include "ServerOptions.h"
+
+#include <simplyfile/Epoll.h>
+#include <simplyfile/socket/Socket.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cndl {
+
+struct Dispatcher;
+
+// completion based IO for connections accepted from listening sockets
+// the ring signals completions through an eventfd that lives in the regular IO loop (epoll)
+// hence the threads running the IO loop also drive the ring, but only one at a time:
+// all connections of the ring are handled by a single thread (the others keep serving the rest of the IO loop)
+struct UringLoop {
+    using TransmitJob = ConnectionHandler::TransmitJob;
+
+    UringLoop(simplyfile::Epoll& epoll, Dispatcher& dispatcher, ServerOptions const& options, FileReader* file_reader);
+    ~UringLoop();
+
+    UringLoop(UringLoop const&) = delete;
+    UringLoop& operator=(UringLoop const&) = delete;
+
+    // accept connections from ss (which has to be listening already)
+    void listen(simplyfile::ServerSocket& ss);
+
+    // the following are called by the connection handlers from within the loop
+    // submit the jobs as one chain of linked sends (the payloads have to be in memory, file regions cannot be sent)
+    void send(std::uint64_t id, std::deque<TransmitJob> const& jobs);
+    std::size_t maxChainLength() const;
+    // stop and restart receiving on the connection (flow control), data that is already on its way is still delivered
+    void pauseRecv(std::uint64_t id);
+    void resumeRecv(std::uint64_t id);
+    // shut the connection down, it is dropped as soon as nothing is in flight anymore
+    void close(std::uint64_t id);
+
+    // can be called from any thread, lets the connection flush its write queue
+    void schedule(std::uint64_t id);
+
+private:
+    enum class Op : std::uint8_t {
+        accept = 1,
+        recv   = 2,
+        send   = 3,
+        cancel = 4,
+        accept_backoff = 5, // a timeout after which a failed accept is submitted again
+    };
+
+    struct Connection {
+        ConnectionHandler handler;
+        int fd;
+        bool receiving{false};
+        bool recv_paused{false};
+        std::size_t sending{0};
+        bool closing{false};
+    };
+
+    simplyfile::Epoll& epoll;
+    Dispatcher& dispatcher;
+    ServerOptions const& options;
+    FileReader* file_reader;
+
+    IOUring ring;
+    // protects the submission queue against listen calls from outside of the loop
+    std::mutex ring_mutex;
+
+    std::vector<int> listen_fds;
+    std::unordered_map<std::uint64_t, Connection> connections;
+    std::uint64_t next_id{0};
+
+    MPSCQueue<std::uint64_t> scheduled;
+    std::atomic<bool> pending{false};
+    std::atomic<bool> active{false};
+
+    void operator()();
+    void process();
+    void handle(io_uring_cqe const& cqe);
+
+    void submitAccept(std::size_t listen_idx);
+    void submitAcceptBackoff(std::size_t listen_idx);
+    void submitRecv(std::uint64_t id, int fd);
+    void dropIfDone(std::uint64_t id);
+};
+
+}
@@ -112,6 +112,13 @@ void Websocket::onPeerClose() {
     }
 }
 
+void Websocket::reclaimMemory() {
+    // a fragmented message that is still being received keeps its buffer
+    if (frag_buffer.empty()) {
+        frag_buffer.shrink_to_fit();
+    }
+}
+
 void Websocket::send(BinMessage message, OpCode opcode, bool fin, AfterSentCB on_after_sent) {
     ByteBuf serialized{};
     serialized.reserve(message.size() + 2 + 8); // reserve enough space for the header and the optional extra payload_len fields
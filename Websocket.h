@@ -53,6 +53,7 @@ struct Websocket : ProtocolHandler {
     // called from the IO loop
     ConsumeResult onDataReceived(ByteView received) override;
     void onPeerClose() override;
+    void reclaimMemory() override;
 
     // called from the application
     void send(AnyMessage message, AfterSentCB on_after_sent={});
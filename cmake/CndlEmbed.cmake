@@ -0,0 +1,32 @@
+# cndl_embed_directory(<target> <name> <directory>)
+#
+# packs every file below <directory> into a sorted, read only table of assets and compiles it into <target>
+# content types, ETags and compressed variants (precompressed .br/.gz siblings or gzip for compressible types)
+# are computed at build time, the table is declared in the generated header <name>.h as
+#     extern cndl::EmbeddedAssets const <name>;
+# and is meant to be served by cndl::EmbeddedFileHandler
+function(cndl_embed_directory target name directory)
+    get_filename_component(directory ${directory} ABSOLUTE)
+    if(TARGET cndl-embed)
+        set(generator cndl-embed)
+    else()
+        find_program(CNDL_EMBED_EXECUTABLE cndl-embed)
+        if(NOT CNDL_EMBED_EXECUTABLE)
+            message(FATAL_ERROR "cndl-embed not found")
+        endif()
+        set(generator ${CNDL_EMBED_EXECUTABLE})
+    endif()
+
+    # CONFIGURE_DEPENDS makes adding or removing a file rerun the glob
+    file(GLOB_RECURSE files CONFIGURE_DEPENDS ${directory}/*)
+    set(out_dir ${CMAKE_CURRENT_BINARY_DIR}/cndl_embed)
+    file(MAKE_DIRECTORY ${out_dir})
+    add_custom_command(
+        OUTPUT ${out_dir}/${name}.cpp ${out_dir}/${name}.h
+        COMMAND ${generator} ${name} ${directory} ${out_dir}/${name}.cpp ${out_dir}/${name}.h
+        DEPENDS ${generator} ${files}
+        COMMENT "Embedding ${directory} as ${name}"
+        VERBATIM)
+    target_sources(${target} PRIVATE ${out_dir}/${name}.cpp ${out_dir}/${name}.h)
+    target_include_directories(${target} PRIVATE ${out_dir})
+endfunction()
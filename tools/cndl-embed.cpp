@@ -0,0 +1,278 @@
+// packs a directory into a table of cndl::EmbeddedAsset (see EmbeddedAssets.h) that is compiled into a program
+// usage: cndl-embed <name> <directory> <output.cpp> <output.h>
+#include "../ContentEncoding.h"
+#include "../EmbeddedAssets.h"
+#include "../ETag.h"
+#include "../Response.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Variant {
+    std::string_view encoding;
+    cndl::ByteBuf content;
+};
+
+struct Asset {
+    std::string path;
+    std::string_view content_type;
+    cndl::ByteBuf content;
+    std::vector<Variant> variants;
+};
+
+std::optional<cndl::ByteBuf> read_file(fs::path const& path) {
+    std::ifstream in{path, std::ios::binary};
+    if (not in) {
+        return std::nullopt;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    auto str = std::move(ss).str();
+    auto const* data = reinterpret_cast<std::byte const*>(str.data());
+    return cndl::ByteBuf{data, data + str.size()};
+}
+
+// files next to which there is a precompressed sibling become variants of that file, just like StaticFileHandler treats them
+std::vector<Asset> collect(fs::path const& dir) {
+    std::map<std::string, fs::path> files;
+    for (auto const& entry : fs::recursive_directory_iterator{dir}) {
+        if (entry.is_regular_file()) {
+            files.emplace(entry.path().lexically_relative(dir).generic_string(), entry.path());
+        }
+    }
+    auto is_sibling = [&](std::string const& path) {
+        return std::any_of(begin(cndl::precompressed_siblings), end(cndl::precompressed_siblings), [&](auto const& sibling) {
+            auto [encoding, extension] = sibling;
+            return path.ends_with(extension) and files.contains(path.substr(0, path.size() - extension.size()));
+        });
+    };
+
+    std::vector<Asset> assets;
+    for (auto const& [path, fs_path] : files) {
+        if (is_sibling(path)) {
+            continue;
+        }
+        auto content = read_file(fs_path);
+        if (not content) {
+            throw std::runtime_error("cannot read " + fs_path.native());
+        }
+        Asset asset{path, cndl::Response::contentTypeLookup(fs_path.extension().native()), std::move(*content), {}};
+        for (auto [encoding, extension] : cndl::precompressed_siblings) {
+            if (auto it = files.find(path + std::string{extension}); it != files.end()) {
+                if (auto sibling = read_file(it->second)) {
+                    asset.variants.push_back({encoding, std::move(*sibling)});
+                }
+            }
+        }
+        bool has_gzip = std::any_of(begin(asset.variants), end(asset.variants), [](auto const& v) { return v.encoding == "gzip"; });
+        if (not has_gzip and cndl::is_compressible(asset.content_type)) {
+            auto gzipped = cndl::gzip_compress(asset.content);
+            if (cndl::worth_compressing(asset.content.size(), gzipped.size())) {
+                asset.variants.push_back({"gzip", std::move(gzipped)});
+            }
+        }
+        assets.emplace_back(std::move(asset));
+    }
+    return assets;
+}
+
+// hash and displace: the buckets with the most paths get their seeds first, while most slots are still free
+struct PerfectHash {
+    std::vector<std::uint32_t> seeds;
+    std::vector<std::uint32_t> slots;
+};
+
+PerfectHash make_perfect_hash(std::vector<Asset> const& assets) {
+    PerfectHash hash;
+    if (assets.empty()) {
+        return hash;
+    }
+    hash.seeds.resize(std::max<std::size_t>(1, assets.size() / 2));
+    hash.slots.resize(assets.size() + assets.size() / 4 + 1, cndl::EmbeddedAssets::empty_slot);
+
+    std::vector<std::vector<std::uint32_t>> buckets(hash.seeds.size());
+    for (std::uint32_t i{0}; i < assets.size(); ++i) {
+        buckets[cndl::embedded_asset_hash(assets[i].path, 0) % buckets.size()].push_back(i);
+    }
+    std::vector<std::uint32_t> order(buckets.size());
+    std::iota(begin(order), end(order), 0);
+    std::stable_sort(begin(order), end(order), [&](auto l, auto r) { return buckets[l].size() > buckets[r].size(); });
+
+    std::vector<std::size_t> placed;
+    for (auto b : order) {
+        if (buckets[b].empty()) {
+            break;
+        }
+        for (std::uint32_t seed{1};; ++seed) {
+            placed.clear();
+            for (auto i : buckets[b]) {
+                auto slot = cndl::embedded_asset_hash(assets[i].path, seed) % hash.slots.size();
+                if (hash.slots[slot] != cndl::EmbeddedAssets::empty_slot or std::find(begin(placed), end(placed), slot) != end(placed)) {
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (placed.size() == buckets[b].size()) {
+                for (std::size_t j{0}; j < placed.size(); ++j) {
+                    hash.slots[placed[j]] = buckets[b][j];
+                }
+                hash.seeds[b] = seed;
+                break;
+            }
+        }
+    }
+    return hash;
+}
+
+// printable characters as they are, everything else as three digit octal escape (which cannot swallow the next character)
+void write_literal(std::ostream& out, std::string_view data) {
+    constexpr std::size_t line_length = 120;
+    std::size_t column{0};
+    out << "\"";
+    for (char c : data) {
+        auto u = static_cast<unsigned char>(c);
+        if (column >= line_length) {
+            out << "\"\n    \"";
+            column = 0;
+        }
+        if (u == '"' or u == '\\') {
+            out << '\\' << c;
+            column += 2;
+        } else if (u >= 0x20 and u < 0x7f and u != '?') {
+            out << c;
+            ++column;
+        } else {
+            out << '\\' << static_cast<char>('0' + (u >> 6)) << static_cast<char>('0' + ((u >> 3) & 7)) << static_cast<char>('0' + (u & 7));
+            column += 4;
+        }
+    }
+    out << "\"";
+}
+
+std::string_view as_chars(cndl::ByteBuf const& buf) {
+    return {reinterpret_cast<char const*>(buf.data()), buf.size()};
+}
+
+void write_content(std::ostream& out, std::string const& name, cndl::ByteBuf const& content) {
+    out << "constexpr char " << name << "[] = ";
+    write_literal(out, as_chars(content));
+    out << ";\n";
+}
+
+void write_source(std::ostream& out, std::string const& name, std::string const& header, std::vector<Asset> const& assets, PerfectHash const& hash) {
+    out << "// generated by cndl-embed, do not edit\n"
+        << "#include \"" << header << "\"\n\n"
+        << "namespace {\n\n"
+        << "using namespace std::literals::string_view_literals;\n\n";
+    for (std::size_t i{0}; i < assets.size(); ++i) {
+        auto const& asset = assets[i];
+        out << "// " << asset.path << "\n";
+        write_content(out, "content_" + std::to_string(i), asset.content);
+        for (std::size_t j{0}; j < asset.variants.size(); ++j) {
+            write_content(out, "content_" + std::to_string(i) + "_" + std::to_string(j), asset.variants[j].content);
+        }
+        if (not asset.variants.empty()) {
+            out << "constexpr cndl::EmbeddedAsset::Variant variants_" << i << "[] = {\n";
+            for (std::size_t j{0}; j < asset.variants.size(); ++j) {
+                auto const& variant = asset.variants[j];
+                auto content = "content_" + std::to_string(i) + "_" + std::to_string(j);
+                out << "    {\"" << variant.encoding << "\"sv, {" << content << ", " << variant.content.size() << "}, "
+                    << "R\"(" << cndl::make_etag(variant.content) << ")\"sv},\n";
+            }
+            out << "};\n";
+        }
+        out << "\n";
+    }
+
+    if (assets.empty()) {
+        // arrays cannot be empty
+        out << "}\n\n"
+            << "constinit cndl::EmbeddedAssets const " << name << "{};\n";
+        return;
+    }
+    out << "constexpr cndl::EmbeddedAsset assets[] = {\n";
+    for (std::size_t i{0}; i < assets.size(); ++i) {
+        auto const& asset = assets[i];
+        out << "    {";
+        write_literal(out, asset.path);
+        out << "sv, \"" << asset.content_type << "\"sv, R\"(" << cndl::make_etag(asset.content) << ")\"sv, "
+            << "{content_" << i << ", " << asset.content.size() << "}, ";
+        if (asset.variants.empty()) {
+            out << "{}},\n";
+        } else {
+            out << "variants_" << i << "},\n";
+        }
+    }
+    out << "};\n\n";
+
+    auto write_table = [&](std::string_view table_name, std::vector<std::uint32_t> const& values) {
+        out << "constexpr std::uint32_t " << table_name << "[] = {";
+        for (std::size_t i{0}; i < values.size(); ++i) {
+            out << (i % 16 == 0 ? "\n    " : " ") << values[i] << "u,";
+        }
+        out << "\n};\n";
+    };
+    write_table("seeds", hash.seeds);
+    write_table("slots", hash.slots);
+    out << "\n}\n\n"
+        << "constinit cndl::EmbeddedAssets const " << name << "{assets, seeds, slots};\n";
+}
+
+void write_header(std::ostream& out, std::string const& name) {
+    out << "// generated by cndl-embed, do not edit\n"
+        << "#pragma once\n\n"
+        << "#include <cndl/EmbeddedAssets.h>\n\n"
+        << "extern cndl::EmbeddedAssets const " << name << ";\n";
+}
+
+// rewriting an unchanged file would make everything that includes it recompile
+void write_if_changed(fs::path const& path, std::string const& content) {
+    if (auto old = read_file(path); old and as_chars(*old) == content) {
+        return;
+    }
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out << content;
+    if (not out) {
+        throw std::runtime_error("cannot write " + path.native());
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 5) {
+        std::cerr << "usage: " << argv[0] << " <name> <directory> <output.cpp> <output.h>\n";
+        return 1;
+    }
+    std::string name = argv[1];
+    fs::path dir = argv[2];
+    fs::path source_path = argv[3];
+    fs::path header_path = argv[4];
+    try {
+        auto assets = collect(dir);
+        auto hash = make_perfect_hash(assets);
+
+        std::ostringstream source;
+        write_source(source, name, header_path.filename().native(), assets, hash);
+        std::ostringstream header;
+        write_header(header, name);
+        write_if_changed(source_path, std::move(source).str());
+        write_if_changed(header_path, std::move(header).str());
+    } catch (std::exception const& e) {
+        std::cerr << argv[0] << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}